@@ -3,6 +3,11 @@
 /* appearance */
 static const unsigned int borderWidth  = 1;        /* border pixel of windows */
 static const unsigned int snap         = 32;       /* snap pixel */
+static const unsigned int dragRate     = 0;        /* move/resize updates per second, 0 means the monitor refresh rate */
+static const unsigned int syncTimeout  = 100;      /* ms to wait for a resized client to draw its last size */
+static const unsigned int titleUpdateInterval = 100; /* ms between title fetches for one client, 0 fetches every change */
+static const int printStats            = 0;        /* 1 means print performance counters to stderr on exit */
+static const unsigned int barThreads   = 0;        /* bar renderer threads, each on its own X connection; 0 draws bars inline */
 static const int showbar               = 0;        /* 0 means no bar */
 static const int topbar                = 0;        /* 0 means bottom bar */
 static const char *fonts[]             = { "Roboto-Regular:size=12" };
@@ -20,6 +25,27 @@ static const char *colors[][3]         = {
 /* tagging */
 static const char *tags[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9" };
 
+/* status, drawn by dwm itself instead of read from the root window name */
+static const int builtinStatus         = 0;        /* 1 means use the blocks below */
+static const char statusSeparator[]    = " | ";
+static const char statusFifo[]         = "";       /* "<block> <text>" lines written here set a block, "" disables */
+static const StatusBlock statusBlocks[] = {
+	/* name       function         argument            interval (s) */
+	{ "net",      status_netrate,  "wlan0",            2 },
+	{ "memory",   status_memory,   NULL,               5 },
+	{ "load",     status_load,     NULL,               5 },
+	{ "battery",  status_battery,  "BAT0",             30 },
+	{ "music",    NULL,            NULL,               0 }, /* set through statusFifo only */
+	{ "clock",    status_clock,    "%a %d %b %H:%M",   1 },
+};
+
+/* journal of client tags, monitors and floating geometry, replayed after a crash */
+static const char journalFile[]        = "";       /* "~/.cache/dwm-journal" for example, "" disables */
+
+/* rules, keys and buttons compiled by dwmrc(1) from a text file replace the
+ * ones below; the file is reloaded on SIGHUP and whenever it is rewritten */
+static const char configFile[]         = "";       /* "~/.config/dwm/dwmrc.bin" for example, "" disables */
+
 static const Rule rules[] = {
 	/* xprop(1):
 	 *	WM_CLASS(STRING) = instance, class
@@ -97,6 +123,7 @@ static Key keys[] = {
 	TAGKEYS(                        XK_8,                      7)
 	TAGKEYS(                        XK_9,                      8)
 	{ MODKEY|ShiftMask,             XK_q,      quit,           {0} },
+	{ MODKEY|ControlMask|ShiftMask, XK_q,      restart,        {0} },
 };
 
 /* button definitions */
@@ -0,0 +1 @@
+config.def.h
\ No newline at end of file
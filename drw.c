@@ -1,7 +1,13 @@
 /* See LICENSE file for copyright and license details. */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <X11/Xlib.h>
 #include <X11/Xft/Xft.h>
 
@@ -10,6 +16,7 @@
 
 #define UTF_INVALID 0xFFFD
 #define UTF_SIZ     4
+#define HASASCII(F, C) ((F)->ascii[(unsigned char)(C) >> 3] & 1 << ((C) & 7))
 
 static const unsigned char utfbyte[UTF_SIZ + 1] = {0x80,    0, 0xC0, 0xE0, 0xF0};
 static const unsigned char utfmask[UTF_SIZ + 1] = {0xC0, 0x80, 0xE0, 0xF0, 0xF8};
@@ -44,6 +51,10 @@ utf8decode(const char *c, long *u, size_t clen)
 	*u = UTF_INVALID;
 	if (!clen)
 		return 0;
+	if (!((unsigned char)c[0] & 0x80)) {
+		*u = c[0];
+		return 1;
+	}
 	udecoded = utf8decodebyte(c[0], &len);
 	if (!BETWEEN(len, 1, UTF_SIZ))
 		return 1;
@@ -60,6 +71,64 @@ utf8decode(const char *c, long *u, size_t clen)
 	return len;
 }
 
+/* Length of the prefix of s in printable ASCII (0x20 to 0x7e), stopping at
+ * the NUL. The vector loops only do aligned loads: the one that finds the
+ * terminator may read bytes past it, but never across a page boundary, and
+ * it always includes a valid byte (Valgrind's default --partial-loads-ok).
+ * AddressSanitizer checks the whole load, so it is told to skip this one. */
+#if defined(__GNUC__)
+__attribute__((no_sanitize_address))
+#endif
+static size_t
+printrun(const char *s)
+{
+	const unsigned char *p = (const unsigned char *)s;
+#if defined(__AVX2__) || defined(__SSE2__)
+	unsigned int stop;
+#else
+	size_t word;
+	const size_t ones = (size_t)-1 / 0xff, highs = ones * 0x80;
+#endif
+
+#if defined(__AVX2__)
+	for (; (uintptr_t)p & 31; p++)
+		if (*p < 0x20 || *p > 0x7e)
+			return p - (const unsigned char *)s;
+	for (;; p += 32) {
+		/* signed compare: bytes >= 0x80 are negative and fail it */
+		__m256i v = _mm256_load_si256((const __m256i *)p);
+		stop = ~_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x1f)))
+		     | _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+		if (stop)
+			return p - (const unsigned char *)s + __builtin_ctz(stop);
+	}
+#elif defined(__SSE2__)
+	for (; (uintptr_t)p & 15; p++)
+		if (*p < 0x20 || *p > 0x7e)
+			return p - (const unsigned char *)s;
+	for (;; p += 16) {
+		__m128i v = _mm_load_si128((const __m128i *)p);
+		stop = (~_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f))) & 0xffff)
+		     | _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+		if (stop)
+			return p - (const unsigned char *)s + __builtin_ctz(stop);
+	}
+#else
+	for (; (uintptr_t)p & (sizeof(word) - 1); p++)
+		if (*p < 0x20 || *p > 0x7e)
+			return p - (const unsigned char *)s;
+	/* a word at a time: stop at any byte below 0x20 or above 0x7e */
+	for (;; p += sizeof(word)) {
+		memcpy(&word, p, sizeof(word));
+		if ((((word - ones * 0x20) & ~word) | ((word + ones) | word)) & highs)
+			break;
+	}
+	for (; *p >= 0x20 && *p <= 0x7e; p++)
+		;
+	return p - (const unsigned char *)s;
+#endif
+}
+
 Draw *
 drawCreate(Display *dpy, int screen, Window win, unsigned int w, unsigned int h)
 {
@@ -108,6 +177,7 @@ xfont_create(Draw *drw, const char *fontname, FcPattern *fontpattern)
 	Fnt *font;
 	XftFont *xfont = NULL;
 	FcPattern *pattern = NULL;
+	unsigned int c;
 
 	if (fontname) {
 		/* Using the pattern found at font->xfont->pattern does not yield the
@@ -151,6 +221,12 @@ xfont_create(Draw *drw, const char *fontname, FcPattern *fontpattern)
 	font->pattern = pattern;
 	font->height = xfont->ascent + xfont->descent;
 	font->dpy = drw->dpy;
+	for (c = 1; c < 128; c++)
+		if (XftCharExists(drw->dpy, xfont, c))
+			font->ascii[c >> 3] |= 1 << (c & 7);
+	for (c = 0x20; c < 0x7f && HASASCII(font, c); c++)
+		;
+	font->printable = c == 0x7f;
 
 	return font;
 }
@@ -286,6 +362,18 @@ drw_text(Draw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int l
 		utf8str = text;
 		nextfont = NULL;
 		while (*text) {
+			if (!charexists && usedfont == drw->fonts) {
+				/* ASCII the first font has goes to it without decoding */
+				if (usedfont->printable)
+					i = printrun(text);
+				else
+					for (i = 0; text[i] && !(text[i] & 0x80) && HASASCII(usedfont, text[i]); i++)
+						;
+				utf8strlen += i;
+				text += i;
+				if (!*text)
+					break;
+			}
 			utf8charlen = utf8decode(text, &utf8codepoint, UTF_SIZ);
 			for (curfont = drw->fonts; curfont; curfont = curfont->next) {
 				charexists = charexists || XftCharExists(drw->dpy, curfont->xfont, utf8codepoint);
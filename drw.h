@@ -9,6 +9,8 @@ typedef struct Fnt {
 	unsigned int height;
 	XftFont *xfont;
 	FcPattern *pattern;
+	unsigned char ascii[16]; /* bitmap of the ASCII characters the font has */
+	int printable;           /* has all of printable ASCII, no bitmap test needed */
 	struct Fnt *next;
 } Fnt;
 
@@ -20,25 +20,47 @@
  *
  * To understand everything else, start reading main().
  */
+#include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
+#include <X11/XKBlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/sync.h>
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
 #include <X11/Xft/Xft.h>
 
 #include "drw.h"
+#include "dwmrc.h"
+#include "journal.h"
+#include "match.h"
+#include "status.h"
 #include "util.h"
 
 /* macros */
@@ -53,17 +75,19 @@
 #define WIDTH(X)                ((X)->w + 2 * (X)->borderWidth)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->borderWidth)
 #define TAGMASK                 ((1 << LENGTH(tags)) - 1)
-#define TEXTW(X)                (drw_fontset_getwidth(draw, (X)) + leftRightPad)
+#define TEXTW(X)                (textwidth(X) + leftRightPad)
 
 /* enums */
 enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
 enum { SchemeNorm, SchemeSel }; /* color schemes */
 enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
        NetWMFullscreen, NetActiveWindow, NetWMWindowType,
-       NetWMWindowTypeDialog, NetClientList, NetLast }; /* EWMH atoms */
+       NetWMWindowTypeDialog, NetClientList, NetWMSyncRequest,
+       NetWMSyncRequestCounter, NetLast }; /* EWMH atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
 enum { ClickTagBar, ClickLayoutSymbol, ClickStatusText, ClickWindowTitle,
        ClickClientWindow, ClickRootWindow, ClkLast }; /* clicks */
+enum { DragNone, DragMove, DragResize }; /* interactive pointer operations */
 
 typedef union {
 	int i;
@@ -81,19 +105,26 @@ typedef struct {
 } Button;
 
 typedef struct Monitor Monitor;
-typedef struct Client { // Any regular window (not a bar window, I believe)
+typedef struct { // Client state that list walks and layouts never look at
 	char name[256];
 	float mina, maxa;
-	int x, y, w, h;
-	int oldx, oldy, oldw, oldh;
 	int basew, baseh, incw, inch, maxw, maxh, minw, minh;
-	int borderWidth, oldBorderWidth;
-	unsigned int tags;
-	int isFixed, isFloating, isUrgent, neverFocus, oldState, isFullscreen;
+	int oldx, oldy, oldw, oldh;
+	int oldBorderWidth;
+	long long titleFetched; // now() of the last title fetch, see titlenotify()
+} ClientCold;
+
+typedef struct Client { // Any regular window (not a bar window, I believe)
+	/* hot fields, these must stay within the first cache line */
 	struct Client *next; // Next client (Super + j)
 	struct Client *selectionNext; // Next client in the order that they were selected
 	Monitor *monitor;
 	Window window;
+	int x, y, w, h;
+	int borderWidth;
+	unsigned int tags;
+	unsigned int isFloating : 1, isFullscreen : 1, isUrgent : 1, isFixed : 1, neverFocus : 1, oldState : 1, titleDirty : 1;
+	ClientCold cold;
 } Client;
 
 typedef struct {
@@ -103,6 +134,11 @@ typedef struct {
 	const Argument argument;
 } Key;
 
+typedef struct {
+	unsigned int modifier; /* CLEANMASK'ed Key modifier */
+	const Key *key;
+} KeyBinding;
+
 typedef struct {
 	const char *symbol;
 	void (*arrange)(Monitor *);
@@ -121,14 +157,49 @@ struct Monitor {
 	unsigned int tagSet[2];
 	int showBar;
 	int topBar;
+	int refreshRate;      /* Hz, paces interactive moves and resizes */
+	Atom output;          /* RandR monitor name, follows the monitor across changes */
 	Client *clients;
 	Client *selectedClient;
 	Client *stack;
 	Monitor *next;
 	Window barWindow;
+	unsigned int barWorker; /* picks the renderer of this bar, fixed while the monitor lives */
 	const Layout *layouts[2];
 };
 
+typedef struct {
+	char name[256];
+	unsigned int isSelected:1, isFloating:1, isFixed:1;
+} BarTitle;
+
+/* Everything needed to draw one bar, copied so that a renderer thread
+ * never touches Client or Monitor */
+typedef struct BarSnapshot BarSnapshot;
+struct BarSnapshot {
+	BarSnapshot *next;
+	Window window;
+	int width;
+	int showStatus;
+	int statusWidth;
+	char status[STATUS_MAX];
+	char layoutSymbol[16];
+	unsigned int selectedTags, occupiedTags, urgentTags, focusedTags;
+	int nTitles;
+	BarTitle titles[];
+};
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	Display *display;     /* own connection, requests never interleave with ours */
+	Draw *draw;
+	Color **scheme;
+	BarSnapshot *queue;   /* at most one snapshot per bar window */
+	int stop;
+} BarWorker;
+
 typedef struct {
 	const char *class;
 	const char *instance;
@@ -138,7 +209,107 @@ typedef struct {
 	int monitor;
 } Rule;
 
+typedef struct { // activeRules compiled for applyrules(), see compilerules()
+	Matcher *field[3];      // class, instance and title patterns, pattern i is activeRules[i]
+	unsigned char *need;    // fields rule i has patterns for, 1 class, 2 instance, 4 title
+	unsigned char *seen;    // fields rule i matched for the window being managed
+	size_t *always, nalways; // rules without patterns
+	size_t *matched, nmatched;
+	Monitor **monitor;      // activeRules[i].monitor resolved, NULL when there is no such monitor
+	int dirty;              // monitors changed since the last resolverules()
+} RuleSet;
+
+typedef struct { // Rules and bindings loaded from configFile, see loadconfig()
+	void *map;              // the mmapped file, strings point into it
+	size_t size;
+	Rule *rules;
+	Key *keys;
+	Button *buttons;
+	size_t nrules, nkeys, nbuttons;
+	const char **argv;      // storage for command arguments
+} Config;
+
+/* Session handed over by restart(): a header, the monitors, then the clients.
+ * Lists are stored as indices into the clients, STATE_NONE ending them. */
+#define STATE_MAGIC             0x54535744  /* "DWST" */
+#define STATE_NONE              0xffffffffu
+
+typedef struct {
+	uint32_t magic;
+	uint32_t headerSize, monitorSize, clientSize; // a binary with other structs rescans instead
+	uint32_t nmonitors, nclients;
+	uint32_t selectedMonitor;
+	uint32_t unused;        // keeps the records after it 8 byte aligned
+} StateHeader;
+
+typedef struct {
+	float masterFactor;
+	int32_t nMaster, showBar;
+	uint32_t selectedTags, selectedLayout, tagSet[2];
+	uint32_t layouts[2];    // indices into layouts[]
+	uint32_t clients, stack, selectedClient;
+} StateMonitor;
+
+typedef struct {
+	uint32_t window;
+	uint32_t monitor;
+	uint32_t next, selectionNext;
+	int32_t x, y, w, h, borderWidth;
+	uint32_t tags;
+	uint8_t isFloating, isFullscreen, isUrgent, isFixed, neverFocus, oldState;
+	ClientCold cold;        // title and hints as last fetched, nothing is fetched again
+} StateClient;
+
+typedef struct { // Move or resize in progress, advanced by the events of the main loop
+	int type;
+	Client *client;
+	int originX, originY; // Client position when the drag started
+	int startX, startY;   // Pointer position when the drag started
+	int x, y;             // Latest pointer position
+	int pending;          // The latest pointer position has not been applied yet
+	long long started;    // When the drag started, see now()
+	long long pendingSince; // When the pending position arrived
+	long long lastUpdate; // When the last position was applied
+	unsigned long updates;
+	XSyncCounter syncCounter; // _NET_WM_SYNC_REQUEST counter of a resized client, if it has one
+	XSyncAlarm syncAlarm;
+	XSyncValue syncValue; // Last value requested from the client
+	int syncWaiting;      // The client has not acknowledged the last size yet
+	long long syncRequested;
+} Drag;
+
+typedef struct { // Grid over the monitor window areas, see pointToMonitor()
+	int *xs, *ys;         // Sorted distinct monitor edges
+	int nx, ny;
+	Monitor **cells;      // (nx - 1) * (ny - 1) cells, the first monitor covering each or NULL
+	Monitor *last;        // Result of the previous lookup
+	int dirty;
+} MonitorMap;
+
+typedef struct { // Totals over all drags, see printstats()
+	unsigned long drags, updates;
+	long long duration, latency, maxLatency; // microseconds
+} DragStats;
+
+typedef struct { // Status updates, see printstats()
+	unsigned long redrawn, unchanged;
+} StatusStats;
+
+typedef struct { // A spawned command, kept after it exits for printstats()
+	pid_t pid;
+	char name[32];
+	long long started, ended; // now(), ended is 0 while it runs
+	int status;               // as returned by waitpid()
+} Child;
+
+typedef struct { // A descriptor run() waits on, see addsource()
+	int fd;
+	void (*ready)(void); // Called when fd is readable, NULL for the X connection
+} Source;
+
 /* function declarations */
+static void addsource(int fd, void (*ready)(void));
+static void adoptstate(Window *children, unsigned int n);
 static void applyrules(Client *c);
 static int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact);
 static void arrange(Monitor *m);
@@ -146,27 +317,52 @@ static void arrangemon(Monitor *m);
 static void attach(Client *c);
 static void attachBelow(Client *c);
 static void attachStack(Client *c);
+static BarSnapshot *barsnapshot(Monitor *m);
+static void *barworker(void *arg);
 static void buttonPress(XEvent *event);
+static void buttonRelease(XEvent *event);
 static void checkOtherWindowManager(void);
+static void claimjournal(void);
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
 static void clientmessage(XEvent *e);
+static void compactjournal(void);
+static int compareclient(const void *a, const void *b);
+static int comparesize(const void *a, const void *b);
+static int comparewindow(const void *a, const void *b);
+static int comparewindowrecord(const void *a, const void *b);
+static void compilerules(void);
+static void configchanged(void);
 static void configure(Client *c);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
+static unsigned int countrepeats(XKeyEvent *ev);
 static Monitor *createMonitor(void);
+static size_t ctprefix(const unsigned char *s, size_t len);
 static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachStack(Client *c);
 static Monitor *dirtomon(int dir);
 static void drawBar(Monitor *monitor);
 static void drawBars(void);
+static void drawstatus(void);
+static long long dragdue(void);
+static void dragend(int apply);
+static void dragexpired(void);
+static long long draginterval(void);
+static void dragtimer(long long due);
+static void dragupdate(void);
 static void enternotify(XEvent *e);
+static char *expandpath(const char *path);
 static void expose(XEvent *e);
+static void flushtitles(void);
 static void focus(Client *client);
 static void focusIn(XEvent *e);
 static void focusmon(const Argument *arg);
 static void focusStack(const Argument *argument);
+static void freebarworker(BarWorker *w);
+static void freeconfig(Config *cf);
+static void freerules(void);
 static Atom getatomprop(Client *c, Atom prop);
 static int getRootPointer(int *x, int *y);
 static long getState(Window window);
@@ -174,29 +370,54 @@ static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
 static void grabButtons(Client *c, int focused);
 static void grabkeys(void);
 static void incnmaster(const Argument *arg);
+static void journalclient(Client *c, int gone);
 static void keyPress(XEvent *event);
 static void killclient(const Argument *arg);
+static void leavenotify(XEvent *e);
+static Config *loadconfig(const char *path);
 static void manage(Window window, XWindowAttributes *windowAttributes);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
 static void monocle(Monitor *m);
+static long long now(void);
 static void motionNotify(XEvent *e);
 static void movemouse(const Argument *arg);
 static Client *nexttagged(Client *c);
 static Client *nexttiled(Client *c);
+static Monitor *pointToMonitor(int x, int y);
 static void pop(Client *);
+static void printstats(void);
+static void reapchildren(void);
 static void propertynotify(XEvent *e);
+static int queryRootPointer(int *x, int *y);
+static void postbar(BarWorker *w, BarSnapshot *s);
 static void quit(const Argument *arg);
+#ifdef XRANDR
+static void randrnotify(XEvent *e);
+#endif /* XRANDR */
+static int rcargument(const RcArgument *a, const char *strings, size_t n, const char ***argv, Argument *out);
+static size_t rccommand(const char *strings, size_t n, uint32_t offset);
+static void (*rcfunction(const char *strings, size_t n, uint32_t offset, uint32_t type))(const Argument *);
+static int rcstring(const char *strings, size_t n, uint32_t offset, const char **s);
+static void recordclient(Client *c, JournalRecord *r);
 static Monitor *rectangleToMonitor(int x, int y, int w, int h);
+static void reexec(char *argv[]);
+static void reloadconfig(void);
+static void renderbar(Draw *d, Color **scm, const BarSnapshot *s);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
 static void resizemouse(const Argument *arg);
+static void resolverules(void);
 static void restack(Monitor *m);
+static void restart(const Argument *arg);
+static void restoreclient(Client *c);
+static void rulehit(size_t id, void *arg);
 static void run(void);
 static void scan(void);
 static int sendevent(Client *c, Atom proto);
 static void sendmon(Client *c, Monitor *m);
 static void setclientstate(Client *c, long state);
+static void setconfig(Config *cf);
 static void setFocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
 static void setlayout(const Argument *arg);
@@ -204,10 +425,20 @@ static void setmfact(const Argument *arg);
 static void setup(void);
 static void seturgent(Client *c, int urg);
 static void showhide(Client *c);
-static void sigchld(int unused);
+static void setupsignals(void);
+static void signalnotify(void);
 static void spawn(const Argument *argument);
+static void startbarworkers(void);
+static uint32_t stateindex(Client **sorted, size_t n, Client *c);
+static void stopbarworkers(void);
+static void syncalarm(XEvent *e);
+static void syncinit(Client *c);
+static void syncrequest(Client *c);
 static void tag(const Argument *arg);
 static void tagmon(const Argument *arg);
+static unsigned int textwidth(const char *text);
+static void titlenotify(Client *c);
+static void titletimer(long long due);
 static void tile(Monitor *);
 static void dwindle(Monitor *);
 static void toggleBar(const Argument *argument);
@@ -218,34 +449,70 @@ static void unfocus(Client *c, int setfocus);
 static void unmanage(Client *c, int destroyed);
 static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
+static void updateblocks(void);
 static void updatebars(void);
 static void updateclientlist(void);
 static int updateGeometry(void);
+static void updatemonitormap(void);
+#ifdef XRANDR
+static int updaterandr(void);
+#endif /* XRANDR */
+static void updatekeyboard(void);
 static void updatenumlockmask(void);
+static void updaterefreshrates(void);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
-static void updatetitle(Client *c);
+static int updatetitle(Client *c);
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
 static void view(const Argument *arg);
+static void watchconfig(void);
 static Client *windowToClient(Window window);
 static Monitor *windowToMonitor(Window window);
 static int xerror(Display *dpy, XErrorEvent *ee);
 static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
+static void xkbnotify(XEvent *e);
+static int xfttext(Draw *d, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert);
+static unsigned int xftwidth(Draw *d, const char *text);
 static void zoom(const Argument *arg);
 
 /* variables */
 static const char broken[] = "broken";
-static char statusText[256]; // Bottom left text, dwm-version by default. It is set with xsetroot
+static char statusText[STATUS_MAX]; // Bottom left text, dwm-version by default. It is set with xsetroot
 static int screen;
 static int screenWidth, screenHeight; // X display screen geometry width, height
+static char *configPath; // configFile with ~ expanded, NULL when bindings come from config.h only
+static const char *configName; // last component of configPath
+static Config *config; // loaded rules and bindings, NULL while the ones in config.h are used
+static int configWatchFd = -1; // inotify on the directory of configPath
+static int signalFd = -1; // SIGCHLD, SIGHUP and SIGUSR1, see signalnotify()
+static JournalRecord *journalReplay; // state journaled by the previous session, only while scan() runs
+static size_t nJournalReplay;
+static int journalCompactDue; // compact the journal once the event queue is drained
+static int titleTimerFd = -1; // Fires when a rate limited title is due, see titlenotify()
+static long long titlesDue; // now() the title timer is armed for, 0 when idle
+static int statusfd = -1, statusFifoFd = -1; // Built-in status timer and input FIFO, see status.c
+static char *statusFifoPath; // statusFifo expanded, status.c removes the FIFO by this name
+static int dragTimerFd = -1; // Fires when a throttled drag frame is due, see dragtimer()
+static long long dragDue; // now() the drag timer is armed for, 0 when idle
+static int epollFd = -1; // Every Source, run() sleeps on nothing else
+static Source sources[8];
+static int nSources;
+static int statusWidth, statusDrawnWidth; // Width of statusText, measured once per change, and as last drawn
+static int tagsWidth; // Width of all tag labels
 static int barHeight, barLayoutWidth = 0; // Bar geometry, blw -> barLayoutWidth/barLeftWidth (?) to be determined
 static int leftRightPad; // Sum of left and right padding for text
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
+static KeyBinding *keyBindings; /* grabbed keys grouped by keycode, built by grabkeys() */
+static unsigned int keyIndex[257]; /* bindings of keycode k are keyBindings[keyIndex[k]..keyIndex[k + 1]) */
+static void (*const repeatable[])(const Argument *) = { /* steps scaled by coalesced key repeats */
+	focusStack, incnmaster, setmfact
+};
 static void (*handler[LASTEvent]) (XEvent *) = {
 	[ButtonPress] = buttonPress, // Mouse button click handler
+	[ButtonRelease] = buttonRelease, // Ends a move or resize
 	[ClientMessage] = clientmessage,
 	[ConfigureRequest] = configurerequest,
 	[ConfigureNotify] = configurenotify,
@@ -254,6 +521,7 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 	[Expose] = expose,
 	[FocusIn] = focusIn,
 	[KeyPress] = keyPress, // Keyboard handler
+	[LeaveNotify] = leavenotify,
 	[MappingNotify] = mappingnotify,
 	[MapRequest] = maprequest,
 	[MotionNotify] = motionNotify,
@@ -261,28 +529,241 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 	[UnmapNotify] = unmapnotify
 };
 static Atom wmAtom[WMLast], netAtom[NetLast];
+static Atom utf8String;
 static int running = 1;
+static int restarting; // run() returned for restart(), see reexec()
 static Cur *cursor[CurLast];
+static int pointerX, pointerY, pointerKnown; // Root pointer position as of the last pointer event
+static Drag drag;
+static DragStats dragStats;
+static StatusStats statusStats;
+static Child spawned[32]; // The most recent spawns, a ring indexed by nSpawned
+static unsigned long nSpawned;
+static int haveSync, syncEventBase, syncErrorBase; /* XSync extension */
+static int haveXkb, xkbEventBase; /* XKB, for keyboards that replace the core one */
+#ifdef XRANDR
+static int haveRandr, randrEventBase; /* RandR 1.5 monitors */
+#endif /* XRANDR */
 static Color **scheme;
 static Display *display;
 static Draw *draw;
 static Monitor *monitors, *selectedMonitor; // Monitors really points to the first monitor in a linked list
+static MonitorMap monitorMap = { .dirty = 1 };
+static RuleSet ruleSet = { .dirty = 1 };
+static Pool clientpool, monitorpool; /* slab storage for Client and Monitor */
+static BarWorker *barWorkers;
+static int nBarWorkers;
+static unsigned int nextBarWorker; // Handed to each new Monitor, see drawBar()
+static pthread_mutex_t xftLock = PTHREAD_MUTEX_INITIALIZER; /* Xft keeps process-wide state */
 static Window root, wmcheckwin; // Root is the main window, parent to all the other windows
 
 /* configuration, allows nested code to access above variables */
 #include "config.h"
 
+/* rules and bindings in use, those of config.h until a config file is loaded */
+static const Rule *activeRules = rules;
+static size_t nrules = LENGTH(rules);
+static const Key *activeKeys = keys;
+static size_t nkeys = LENGTH(keys);
+static const Button *activeButtons = buttons;
+static size_t nbuttons = LENGTH(buttons);
+
+/* functions a config file may bind, by name, with the argument types they take */
+#define FUNCTION(f, types) { #f, f, types },
+static const struct {
+	const char *name;
+	void (*function)(const Argument *);
+	uint32_t args;            /* RC_ARG() of each RcArgument type it accepts */
+} functions[] = {
+	RC_FUNCTIONS(FUNCTION)
+};
+#undef FUNCTION
+
 /* compile-time check if all tags fit into an unsigned int bit array. */
 struct NumTags { char limitexceeded[LENGTH(tags) > 31 ? -1 : 1]; };
 
+/* compile-time check if the hot part of Client fits into one cache line. */
+struct ClientHot { char limitexceeded[offsetof(Client, cold) > POOL_ALIGN ? -1 : 1]; };
+
 /* function implementations */
+/* Have run() wake up for fd and call ready once it is readable; fd may be -1
+ * for a source that is not in use */
+void
+addsource(int fd, void (*ready)(void))
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	if (fd < 0)
+		return;
+	if (nSources == LENGTH(sources))
+		die("dwm: too many event sources");
+	sources[nSources] = (Source){ fd, ready };
+	ev.data.ptr = &sources[nSources++];
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		die("epoll_ctl:");
+}
+
+/* Take over the clients of the session restart() handed to us from the
+ * snapshot: a window has to be among the children of the root, which scan()
+ * fetched in one request, and still mapped or iconic, since a client may have
+ * withdrawn it while nobody was listening. That is one request per saved
+ * window instead of scan()'s three. Adopted children are set to None, scan()
+ * manages whatever is left. */
+void
+adoptstate(Window *children, unsigned int n)
+{
+	const char *path = getenv("DWM_STATE");
+	const StateHeader *h;
+	const StateMonitor *sm;
+	const StateClient *sc;
+	Client *c, **adopted, **tail;
+	Monitor *m, **mons;
+	Window **slot;
+	unsigned char *placed;
+	char file[256];
+	const char *base;
+	struct stat st;
+	XWindowAttributes wa;
+	uint32_t i, j, k;
+	void *map;
+	int fd;
+
+	if (!path)
+		return;
+	snprintf(file, sizeof(file), "%s", path);
+	unsetenv("DWM_STATE"); /* not meant for the programs we spawn */
+	/* only a file reexec() made is read, and removed once it checks out */
+	base = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+	if (strncmp(base, "dwm-state-", 10) || (fd = open(file, O_RDONLY | O_CLOEXEC)) < 0)
+		return;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(StateHeader)
+	|| (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return;
+	}
+	close(fd);
+	h = map;
+	if (h->magic != STATE_MAGIC || h->headerSize != sizeof(StateHeader)
+	|| h->monitorSize != sizeof(StateMonitor) || h->clientSize != sizeof(StateClient) || !h->nmonitors
+	|| (uint64_t)st.st_size != sizeof(StateHeader) + (uint64_t)h->nmonitors * sizeof(StateMonitor)
+	   + (uint64_t)h->nclients * sizeof(StateClient)) {
+		munmap(map, st.st_size);
+		return;
+	}
+	unlink(file);
+	sm = (const StateMonitor *)(h + 1);
+	sc = (const StateClient *)(sm + h->nmonitors);
+
+	/* saved monitors map to the current ones in order, the clients of
+	 * monitors that are gone move to the first one */
+	mons = ecalloc(h->nmonitors, sizeof(Monitor *));
+	for (i = 0, m = monitors; i < h->nmonitors; i++) {
+		if (!(mons[i] = m)) {
+			mons[i] = monitors;
+			continue;
+		}
+		m->masterFactor = sm[i].masterFactor;
+		m->nMaster = sm[i].nMaster;
+		m->selectedTags = sm[i].selectedTags & 1;
+		m->tagSet[0] = sm[i].tagSet[0] & TAGMASK;
+		m->tagSet[1] = sm[i].tagSet[1] & TAGMASK;
+		if (sm[i].layouts[0] < LENGTH(layouts) && sm[i].layouts[1] < LENGTH(layouts)) {
+			m->layouts[0] = &layouts[sm[i].layouts[0]];
+			m->layouts[1] = &layouts[sm[i].layouts[1]];
+			m->selectedLayout = sm[i].selectedLayout & 1;
+		}
+		if (m->showBar != !!sm[i].showBar) {
+			m->showBar = !m->showBar;
+			updatebarpos(m);
+			XMoveResizeWindow(display, m->barWindow, m->windowX, m->by, m->windowWidth, barHeight);
+		}
+		m = m->next;
+	}
+	if (h->selectedMonitor < h->nmonitors)
+		selectedMonitor = mons[h->selectedMonitor];
+
+	adopted = ecalloc(MAX(h->nclients, 1), sizeof(Client *));
+	slot = ecalloc(MAX(h->nclients, 1), sizeof(Window *));
+	qsort(children, n, sizeof(Window), comparewindow);
+	for (i = 0; i < h->nclients; i++) {
+		if (sc[i].monitor >= h->nmonitors
+		|| !(slot[i] = bsearch(&(Window){ sc[i].window }, children, n, sizeof(Window), comparewindow)))
+			continue;
+		if (!XGetWindowAttributes(display, sc[i].window, &wa) || wa.override_redirect
+		|| (wa.map_state != IsViewable && getState(sc[i].window) != IconicState)) {
+			slot[i] = NULL; /* withdrawn during the restart, scan() looks at it again */
+			continue;
+		}
+		c = adopted[i] = pool_alloc(&clientpool);
+		c->window = sc[i].window;
+		c->monitor = mons[sc[i].monitor];
+		c->x = sc[i].x;
+		c->y = sc[i].y;
+		c->w = sc[i].w;
+		c->h = sc[i].h;
+		c->borderWidth = sc[i].borderWidth;
+		c->tags = sc[i].tags & TAGMASK;
+		c->isFloating = sc[i].isFloating;
+		c->isFullscreen = sc[i].isFullscreen;
+		c->isUrgent = sc[i].isUrgent;
+		c->isFixed = sc[i].isFixed;
+		c->neverFocus = sc[i].neverFocus;
+		c->oldState = sc[i].oldState;
+		c->cold = sc[i].cold;
+		c->cold.name[sizeof(c->cold.name) - 1] = '\0';
+		XSelectInput(display, c->window, EnterWindowMask | FocusChangeMask | PropertyChangeMask | StructureNotifyMask);
+		grabButtons(c, 0);
+	}
+	for (i = 0; i < h->nclients; i++)
+		if (slot[i])
+			*slot[i] = None;
+
+	/* relink in the saved order, walking no list for longer than it can be */
+	placed = ecalloc(MAX(h->nclients, 1), 1);
+	for (i = 0; i < h->nmonitors; i++) {
+		m = mons[i];
+		for (tail = &m->clients; *tail; tail = &(*tail)->next);
+		for (j = sm[i].clients, k = 0; j < h->nclients && k++ < h->nclients; j = sc[j].next)
+			if ((c = adopted[j]) && c->monitor == m && !(placed[j] & 1)) {
+				placed[j] |= 1;
+				c->next = NULL;
+				*tail = c;
+				tail = &c->next;
+			}
+		for (tail = &m->stack; *tail; tail = &(*tail)->selectionNext);
+		for (j = sm[i].stack, k = 0; j < h->nclients && k++ < h->nclients; j = sc[j].selectionNext)
+			if ((c = adopted[j]) && c->monitor == m && !(placed[j] & 2)) {
+				placed[j] |= 2;
+				c->selectionNext = NULL;
+				*tail = c;
+				tail = &c->selectionNext;
+			}
+		if (sm[i].selectedClient < h->nclients && (c = adopted[sm[i].selectedClient]) && c->monitor == m)
+			m->selectedClient = c;
+	}
+	for (i = 0; i < h->nclients; i++) {
+		if (adopted[i] && !(placed[i] & 1))
+			attach(adopted[i]);
+		if (adopted[i] && !(placed[i] & 2))
+			attachStack(adopted[i]);
+	}
+	free(placed);
+	free(slot);
+	free(adopted);
+	free(mons);
+	munmap(map, st.st_size);
+	updateclientlist();
+	arrange(NULL);
+	focus(NULL);
+}
+
 void
 applyrules(Client *c)
 {
 	const char *class, *instance;
-	unsigned int i;
+	unsigned char field;
+	size_t i;
 	const Rule *r;
-	Monitor *m;
 	XClassHint ch = { NULL, NULL };
 
 	/* rule matching */
@@ -292,18 +773,25 @@ applyrules(Client *c)
 	class    = ch.res_class ? ch.res_class : broken;
 	instance = ch.res_name  ? ch.res_name  : broken;
 
-	for (i = 0; i < LENGTH(rules); i++) {
-		r = &rules[i];
-		if ((!r->title || strstr(c->name, r->title))
-		&& (!r->class || strstr(class, r->class))
-		&& (!r->instance || strstr(instance, r->instance)))
-		{
-			c->isFloating = r->isfloating;
-			c->tags |= r->tags;
-			for (m = monitors; m && m->num != r->monitor; m = m->next);
-			if (m)
-				c->monitor = m;
-		}
+	if (ruleSet.dirty)
+		resolverules();
+	memset(ruleSet.seen, 0, nrules);
+	memcpy(ruleSet.matched, ruleSet.always, ruleSet.nalways * sizeof(size_t));
+	ruleSet.nmatched = ruleSet.nalways;
+	field = 1;
+	match_run(ruleSet.field[0], class, rulehit, &field);
+	field = 2;
+	match_run(ruleSet.field[1], instance, rulehit, &field);
+	field = 4;
+	match_run(ruleSet.field[2], c->cold.name, rulehit, &field);
+	/* later rules override earlier ones, as in config.h */
+	qsort(ruleSet.matched, ruleSet.nmatched, sizeof(size_t), comparesize);
+	for (i = 0; i < ruleSet.nmatched; i++) {
+		r = &activeRules[ruleSet.matched[i]];
+		c->isFloating = !!r->isfloating;
+		c->tags |= r->tags;
+		if (ruleSet.monitor[ruleSet.matched[i]])
+			c->monitor = ruleSet.monitor[ruleSet.matched[i]];
 	}
 	if (ch.res_class)
 		XFree(ch.res_class);
@@ -346,34 +834,34 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 		*w = barHeight;
 	if (resizeHints || c->isFloating || !c->monitor->layouts[c->monitor->selectedLayout]->arrange) {
 		/* see last two sentences in ICCCM 4.1.2.3 */
-		baseismin = c->basew == c->minw && c->baseh == c->minh;
+		baseismin = c->cold.basew == c->cold.minw && c->cold.baseh == c->cold.minh;
 		if (!baseismin) { /* temporarily remove base dimensions */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->cold.basew;
+			*h -= c->cold.baseh;
 		}
 		/* adjust for aspect limits */
-		if (c->mina > 0 && c->maxa > 0) {
-			if (c->maxa < (float)*w / *h)
-				*w = *h * c->maxa + 0.5;
-			else if (c->mina < (float)*h / *w)
-				*h = *w * c->mina + 0.5;
+		if (c->cold.mina > 0 && c->cold.maxa > 0) {
+			if (c->cold.maxa < (float)*w / *h)
+				*w = *h * c->cold.maxa + 0.5;
+			else if (c->cold.mina < (float)*h / *w)
+				*h = *w * c->cold.mina + 0.5;
 		}
 		if (baseismin) { /* increment calculation requires this */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->cold.basew;
+			*h -= c->cold.baseh;
 		}
 		/* adjust for increment value */
-		if (c->incw)
-			*w -= *w % c->incw;
-		if (c->inch)
-			*h -= *h % c->inch;
+		if (c->cold.incw)
+			*w -= *w % c->cold.incw;
+		if (c->cold.inch)
+			*h -= *h % c->cold.inch;
 		/* restore base dimensions */
-		*w = MAX(*w + c->basew, c->minw);
-		*h = MAX(*h + c->baseh, c->minh);
-		if (c->maxw)
-			*w = MIN(*w, c->maxw);
-		if (c->maxh)
-			*h = MIN(*h, c->maxh);
+		*w = MAX(*w + c->cold.basew, c->cold.minw);
+		*h = MAX(*h + c->cold.baseh, c->cold.minh);
+		if (c->cold.maxw)
+			*w = MIN(*w, c->cold.maxw);
+		if (c->cold.maxh)
+			*h = MIN(*h, c->cold.maxh);
 	}
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
@@ -433,6 +921,74 @@ void attachStack(Client *c) {
 	c->monitor->stack = c;
 }
 
+/* Copy what drawBar() shows for m; the caller owns the result */
+BarSnapshot *
+barsnapshot(Monitor *m)
+{
+	int n;
+	Client *c;
+	BarSnapshot *s;
+	BarTitle *t;
+
+	for (n = 0, c = m->clients; c; c = c->next)
+		if (ISVISIBLE(c))
+			n++;
+	s = ecalloc(1, sizeof(BarSnapshot) + n * sizeof(BarTitle));
+	s->window = m->barWindow;
+	s->width = m->windowWidth;
+	if ((s->showStatus = (m == selectedMonitor))) {
+		memcpy(s->status, statusText, sizeof(s->status));
+		s->statusWidth = statusWidth;
+	}
+	memcpy(s->layoutSymbol, m->layoutSymbol, sizeof(s->layoutSymbol));
+	s->selectedTags = m->tagSet[m->selectedTags];
+	if (m == selectedMonitor && m->selectedClient)
+		s->focusedTags = m->selectedClient->tags;
+	for (c = m->clients; c; c = c->next) {
+		s->occupiedTags |= c->tags;
+		if (c->isUrgent)
+			s->urgentTags |= c->tags;
+		if (!ISVISIBLE(c))
+			continue;
+		t = &s->titles[s->nTitles++];
+		memcpy(t->name, c->cold.name, sizeof(t->name));
+		t->isSelected = c == m->selectedClient;
+		t->isFloating = c->isFloating;
+		t->isFixed = c->isFixed;
+	}
+	return s;
+}
+
+/* Renderer thread: draw the newest snapshot of each bar it owns */
+void *
+barworker(void *arg)
+{
+	BarWorker *w = arg;
+	BarSnapshot *s, *next;
+
+	pthread_mutex_lock(&w->lock);
+	while (!w->stop) {
+		if (!w->queue) {
+			pthread_cond_wait(&w->wake, &w->lock);
+			continue;
+		}
+		s = w->queue;
+		w->queue = NULL;
+		pthread_mutex_unlock(&w->lock);
+		for (; s; s = next) {
+			next = s->next;
+			if ((unsigned int)s->width > w->draw->w)
+				drw_resize(w->draw, s->width, barHeight);
+			renderbar(w->draw, w->scheme, s);
+			free(s);
+		}
+		XFlush(w->display);
+		pthread_mutex_lock(&w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
 void buttonPress(XEvent *event) { // Mouse button press handler, does not seem to trigger when clicking on a Window...
 	unsigned int i, x, click;
 	Argument argument = {0};
@@ -440,6 +996,9 @@ void buttonPress(XEvent *event) { // Mouse button press handler, does not seem t
 	Monitor *monitor;
 	XButtonPressedEvent *buttonPressedEvent = &event->xbutton;
 
+	pointerX = buttonPressedEvent->x_root;
+	pointerY = buttonPressedEvent->y_root;
+	pointerKnown = 1;
 	click = ClickRootWindow;
 	/* Focus monitor if necessary */
 	if ((monitor = windowToMonitor(buttonPressedEvent->window)) && monitor != selectedMonitor) {
@@ -461,24 +1020,30 @@ void buttonPress(XEvent *event) { // Mouse button press handler, does not seem t
 			argument.ui = 1 << i; // Set the unsigned integer argument part to some value depending on i (tag mask (?))
 		} else if (buttonPressedEvent->x < x + barLayoutWidth)
 			click = ClickLayoutSymbol; // If the layout button was clicked, set the click type
-		else if (buttonPressedEvent->x > selectedMonitor->windowWidth - (int)TEXTW(statusText))
+		else if (buttonPressedEvent->x > selectedMonitor->windowWidth - (statusWidth - 2 + leftRightPad))
 			click = ClickStatusText; // Check if the status text was clicked
 		else
 			click = ClickWindowTitle;
 	} else if ((client = windowToClient(buttonPressedEvent->window))) {
+		pointerKnown = 0; /* moves inside a client are not reported to us */
 		focus(client);
 		restack(selectedMonitor);
 		XAllowEvents(display, ReplayPointer, CurrentTime);
 		click = ClickClientWindow;
 	}
-    for (i = 0; i < LENGTH(buttons); i++) {
-        if (click == buttons[i].click && buttons[i].function && buttons[i].button == buttonPressedEvent->button
-            && CLEANMASK(buttons[i].mask) == CLEANMASK(buttonPressedEvent->state)) {
-            buttons[i].function(click == ClickTagBar && buttons[i].argument.i == 0 ? &argument : &buttons[i].argument);
+    for (i = 0; i < nbuttons; i++) {
+        if (click == activeButtons[i].click && activeButtons[i].function && activeButtons[i].button == buttonPressedEvent->button
+            && CLEANMASK(activeButtons[i].mask) == CLEANMASK(buttonPressedEvent->state)) {
+            activeButtons[i].function(click == ClickTagBar && activeButtons[i].argument.i == 0 ? &argument : &activeButtons[i].argument);
         }
     }
 }
 
+void buttonRelease(XEvent *event) {
+	if (drag.type != DragNone)
+		dragend(1);
+}
+
 void checkOtherWindowManager(void) {
 	xerrorxlib = XSetErrorHandler(xerrorstart);
 	/* this causes an error if some other window manager is running */
@@ -488,6 +1053,37 @@ void checkOtherWindowManager(void) {
 	XSync(display, False);
 }
 
+/* Window IDs are only meaningful to the X server that handed them out, and
+ * the next server hands out the same ones. The journal is tagged with a token
+ * that is also kept on the root window, which goes away with the server: if
+ * the two differ, the records are from an earlier server and are dropped. */
+void
+claimjournal(void)
+{
+	Atom atom = XInternAtom(display, "_DWM_JOURNAL", False), type;
+	int format;
+	unsigned long nitems, after;
+	unsigned char *data = NULL;
+	uint64_t token = 0;
+	long value[2];
+
+	if (XGetWindowProperty(display, root, atom, 0, 2, False, XA_CARDINAL, &type, &format,
+	                       &nitems, &after, &data) == Success && data) {
+		if (type == XA_CARDINAL && format == 32 && nitems == 2)
+			token = (uint64_t)(((unsigned long *)data)[0] & 0xffffffff) << 32
+			        | (((unsigned long *)data)[1] & 0xffffffff);
+		XFree(data);
+	}
+	if (token && token == journal_token())
+		return;
+	if (getrandom(&token, sizeof(token), GRND_NONBLOCK) != sizeof(token) || !token)
+		token = ((uint64_t)time(NULL) << 32 ^ (uint64_t)getpid() << 16 ^ now()) | 1;
+	journal_reset(token);
+	value[0] = token >> 32;
+	value[1] = token & 0xffffffff;
+	XChangeProperty(display, root, atom, XA_CARDINAL, 32, PropModeReplace, (unsigned char *)value, 2);
+}
+
 void
 cleanup(void)
 {
@@ -496,12 +1092,22 @@ cleanup(void)
 	Monitor *m;
 	size_t i;
 
+	stopbarworkers();
+	status_free();
+	free(statusFifoPath);
+	if (titleTimerFd >= 0)
+		close(titleTimerFd);
+	close(dragTimerFd);
+	close(signalFd);
+	close(epollFd);
 	view(&a);
     selectedMonitor->layouts[selectedMonitor->selectedLayout] = &foo;
 	for (m = monitors; m; m = m->next)
 		while (m->stack)
 			unmanage(m->stack, 0);
+	journal_close();
 	XUngrabKey(display, AnyKey, AnyModifier, root);
+	free(keyBindings);
 	while (monitors)
 		cleanupmon(monitors);
 	for (i = 0; i < CurLast; i++)
@@ -510,9 +1116,21 @@ cleanup(void)
 		free(scheme[i]);
 	XDestroyWindow(display, wmcheckwin);
 	drw_free(draw);
+	freerules();
+	freeconfig(config);
+	free(configPath);
+	if (configWatchFd >= 0)
+		close(configWatchFd);
+	free(monitorMap.xs);
+	free(monitorMap.ys);
+	free(monitorMap.cells);
+	pool_destroy(&clientpool);
+	pool_destroy(&monitorpool);
 	XSync(display, False);
 	XSetInputFocus(display, PointerRoot, RevertToPointerRoot, CurrentTime);
 	XDeleteProperty(display, root, netAtom[NetActiveWindow]);
+	if (printStats)
+		printstats();
 }
 
 void
@@ -528,7 +1146,9 @@ cleanupmon(Monitor *mon)
 	}
 	XUnmapWindow(display, mon->barWindow);
 	XDestroyWindow(display, mon->barWindow);
-	free(mon);
+	monitorMap.dirty = 1;
+	ruleSet.dirty = 1;
+	pool_free(&monitorpool, mon);
 }
 
 void
@@ -550,6 +1170,107 @@ clientmessage(XEvent *e)
 	}
 }
 
+static int
+comparesize(const void *a, const void *b)
+{
+	return (*(const size_t *)a > *(const size_t *)b) - (*(const size_t *)a < *(const size_t *)b);
+}
+
+/* Rewrite the journal as one record per client, see journal_compact() */
+void
+compactjournal(void)
+{
+	JournalRecord *live;
+	Client *c;
+	Monitor *m;
+	size_t n = 0;
+
+	for (m = monitors; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			n++;
+	live = ecalloc(MAX(n, 1), sizeof(JournalRecord));
+	n = 0;
+	for (m = monitors; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			recordclient(c, &live[n++]);
+	journal_compact(live, n);
+	free(live);
+	journalCompactDue = 0;
+}
+
+static int
+compareclient(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)*(Client *const *)a, y = (uintptr_t)*(Client *const *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int
+comparewindowrecord(const void *a, const void *b)
+{
+	const JournalRecord *x = a, *y = b;
+
+	return (x->window > y->window) - (x->window < y->window);
+}
+
+static int
+comparewindow(const void *a, const void *b)
+{
+	return (*(const Window *)a > *(const Window *)b) - (*(const Window *)a < *(const Window *)b);
+}
+
+/* Build one substring matcher per rule field, so applyrules() finds every
+ * matching rule in a pass over each string instead of a strstr per rule */
+void
+compilerules(void)
+{
+	const char **patterns = ecalloc(MAX(nrules, 1), sizeof(char *));
+	size_t i;
+
+	for (i = 0; i < nrules; i++)
+		patterns[i] = activeRules[i].class;
+	ruleSet.field[0] = match_compile(patterns, nrules);
+	for (i = 0; i < nrules; i++)
+		patterns[i] = activeRules[i].instance;
+	ruleSet.field[1] = match_compile(patterns, nrules);
+	for (i = 0; i < nrules; i++)
+		patterns[i] = activeRules[i].title;
+	ruleSet.field[2] = match_compile(patterns, nrules);
+	free(patterns);
+
+	ruleSet.need = ecalloc(MAX(nrules, 1), 1);
+	ruleSet.seen = ecalloc(MAX(nrules, 1), 1);
+	ruleSet.always = ecalloc(MAX(nrules, 1), sizeof(size_t));
+	ruleSet.matched = ecalloc(MAX(nrules, 1), sizeof(size_t));
+	ruleSet.monitor = ecalloc(MAX(nrules, 1), sizeof(Monitor *));
+	ruleSet.nalways = 0;
+	for (i = 0; i < nrules; i++)
+		if (!(ruleSet.need[i] = (activeRules[i].class ? 1 : 0) | (activeRules[i].instance ? 2 : 0) | (activeRules[i].title ? 4 : 0)))
+			ruleSet.always[ruleSet.nalways++] = i;
+	ruleSet.dirty = 1;
+}
+
+/* Reload once the config file is rewritten or moved into place, ignoring
+ * everything else that happens in its directory */
+void
+configchanged(void)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t n, i;
+	int changed = 0;
+
+	while ((n = read(configWatchFd, buf, sizeof(buf))) > 0)
+		for (i = 0; i < n; i += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)(buf + i);
+			if (ev->len && configName && !strcmp(ev->name, configName))
+				changed = 1;
+		}
+	if (changed)
+		reloadconfig();
+}
+
 void
 configure(Client *c)
 {
@@ -579,9 +1300,18 @@ configurenotify(XEvent *e)
 
 	/* TODO: updateGeometry handling sucks, needs to be simplified */
 	if (ev->window == root) {
+		pointerKnown = 0;
 		dirty = (screenWidth != ev->width || screenHeight != ev->height);
         screenWidth = ev->width;
         screenHeight = ev->height;
+#ifdef XRANDR
+		/* monitor changes arrive as RandR events, see randrnotify() */
+		if (haveRandr) {
+			if (dirty)
+				drw_resize(draw, screenWidth, barHeight);
+			return;
+		}
+#endif /* XRANDR */
 		if (updateGeometry() || dirty) {
 			drw_resize(draw, screenWidth, barHeight);
 			updatebars();
@@ -611,19 +1341,19 @@ configurerequest(XEvent *e)
 		else if (c->isFloating || !selectedMonitor->layouts[selectedMonitor->selectedLayout]->arrange) {
 			m = c->monitor;
 			if (ev->value_mask & CWX) {
-				c->oldx = c->x;
+				c->cold.oldx = c->x;
 				c->x = m->monitorX + ev->x;
 			}
 			if (ev->value_mask & CWY) {
-				c->oldy = c->y;
+				c->cold.oldy = c->y;
 				c->y = m->monitorY + ev->y;
 			}
 			if (ev->value_mask & CWWidth) {
-				c->oldw = c->w;
+				c->cold.oldw = c->w;
 				c->w = ev->width;
 			}
 			if (ev->value_mask & CWHeight) {
-				c->oldh = c->h;
+				c->cold.oldh = c->h;
 				c->h = ev->height;
 			}
 			if ((c->x + c->w) > m->monitorX + m->monitorWidth && c->isFloating)
@@ -649,19 +1379,85 @@ configurerequest(XEvent *e)
 	XSync(display, False);
 }
 
+/* Consume the auto-repeated presses of the same key queued right behind ev
+ * and return how many presses there were in total, ev included. */
+unsigned int
+countrepeats(XKeyEvent *ev)
+{
+	unsigned int n = 1;
+	XEvent next;
+
+	while (XEventsQueued(display, QueuedAfterReading)) {
+		XPeekEvent(display, &next);
+		if (next.type != KeyPress || next.xkey.keycode != ev->keycode
+		|| CLEANMASK(next.xkey.state) != CLEANMASK(ev->state))
+			break;
+		XNextEvent(display, &next);
+		n++;
+	}
+	return n;
+}
+
 Monitor * createMonitor(void) {
-    Monitor *monitor = ecalloc(1, sizeof(Monitor));
+    Monitor *monitor = pool_alloc(&monitorpool);
     monitor->tagSet[0] = monitor->tagSet[1] = 1;
     monitor->masterFactor = masterFactor;
     monitor->nMaster = nMaster;
     monitor->showBar = showbar;
     monitor->topBar = topbar;
+    monitor->refreshRate = 60;
+    monitor->barWorker = nextBarWorker++; /* not num, RandR renumbers monitors */
+    monitorMap.dirty = 1;
+    ruleSet.dirty = 1;
     monitor->layouts[0] = &layouts[0];
     monitor->layouts[1] = &layouts[1 % LENGTH(layouts)];
 	strncpy(monitor->layoutSymbol, layouts[0].symbol, sizeof monitor->layoutSymbol);
 	return monitor;
 }
 
+/* Length of the longest prefix of compound text that ends on a whole
+ * character, following the ISO 2022 designations for the width of GL and GR */
+size_t
+ctprefix(const unsigned char *s, size_t len)
+{
+	size_t i = 0, end = 0, j;
+	int gl = 1, gr = 1, w;
+
+	while (i < len) {
+		if (s[i] == 0x1b) { /* ESC intermediates final */
+			for (j = i + 1; j < len && s[j] >= 0x20 && s[j] <= 0x2f; j++);
+			if (j >= len)
+				break;
+			w = s[i + 1] == '$' ? 2 : 1;
+			if (j - i == 3 && s[i + 1] == '%' && s[i + 2] == '/') {
+				/* extended segment, two length bytes and its data */
+				if (j + 2 >= len)
+					break;
+				j += 2 + ((s[j + 1] & 0x7f) << 7 | (s[j + 2] & 0x7f));
+				if (j >= len)
+					break;
+			} else if (s[j - 1] == '(' || s[j - 1] == '$')
+				gl = w;
+			else if (s[j - 1] == ')' || s[j - 1] == '-')
+				gr = w;
+			i = end = j + 1;
+			continue;
+		}
+		if (s[i] == 0x9b) { /* CSI parameters intermediates final */
+			for (j = i + 1; j < len && s[j] >= 0x20 && s[j] <= 0x3f; j++);
+			if (j >= len)
+				break;
+			i = end = j + 1;
+			continue;
+		}
+		w = s[i] < 0x21 || s[i] == 0x7f || (s[i] >= 0x80 && s[i] < 0xa1) ? 1 : s[i] & 0x80 ? gr : gl;
+		if (w > len - i)
+			break;
+		i = end = i + w;
+	}
+	return end;
+}
+
 void
 destroynotify(XEvent *e)
 {
@@ -708,81 +1504,149 @@ dirtomon(int dir)
 	return m;
 }
 
-void drawBar(Monitor *monitor) {
-	int x, w, textWidth = 0, mw, ew = 0;
-	const unsigned int boxs = draw->fonts->height / 9;
-	const unsigned int boxw = draw->fonts->height / 6 + 2;
-	unsigned int i, occ = 0, urg = 0, n = 0;
-	Client *c;
+/* When the pending drag position may be applied: one update per frame, and
+ * a resized client gets up to syncTimeout ms to acknowledge the last size */
+long long
+dragdue(void)
+{
+	long long due = drag.lastUpdate + draginterval();
 
-	if (!monitor->showBar)
-		return;
+	if (drag.syncWaiting)
+		due = MAX(due, drag.syncRequested + syncTimeout * 1000LL);
+	return due;
+}
 
-	/* Draw status first, so it can be overdrawn by tags later */
-	if (monitor == selectedMonitor) { /* Status is only drawn on selected monitor */
-        drawSetColorScheme(draw, scheme[SchemeNorm]);
-        textWidth = TEXTW(statusText) - leftRightPad + 2; /* 2px right padding */
-		drw_text(draw, monitor->windowWidth - textWidth, 0, textWidth, barHeight, 0, statusText, 0);
-	}
+/* Finish the move or resize in progress, apply is zero when the client is going away */
+void
+dragend(int apply)
+{
+	Client *c = drag.client;
+	Monitor *m;
+	XEvent ev;
 
-	for (c = monitor->clients; c; c = c->next) {
-		if (ISVISIBLE(c))
-			n++;
-		occ |= c->tags;
-		if (c->isUrgent)
-			urg |= c->tags;
+	drag.syncWaiting = 0;
+	if (apply && drag.pending)
+		dragupdate();
+	if (drag.syncAlarm)
+		XSyncDestroyAlarm(display, drag.syncAlarm);
+	drag.syncAlarm = None;
+	dragStats.drags++;
+	dragStats.updates += drag.updates;
+	dragStats.duration += now() - drag.started;
+	if (apply && drag.type == DragResize) {
+		XWarpPointer(display, None, c->window, 0, 0, 0, 0, c->w + c->borderWidth - 1, c->h + c->borderWidth - 1);
+		pointerKnown = 0;
 	}
-	x = 0;
-	for (i = 0; i < LENGTH(tags); i++) {
-		w = TEXTW(tags[i]);
-        drawSetColorScheme(draw, scheme[monitor->tagSet[monitor->selectedTags] & 1 << i ? SchemeSel : SchemeNorm]);
-		drw_text(draw, x, 0, w, barHeight, leftRightPad / 2, tags[i], urg & 1 << i);
-		if (occ & 1 << i)
-			drw_rect(draw, x + boxs, boxs, boxw, boxw,
-                     monitor == selectedMonitor && selectedMonitor->selectedClient && selectedMonitor->selectedClient->tags & 1 << i,
-				urg & 1 << i);
-		x += w;
+	XUngrabPointer(display, CurrentTime);
+	drag = (Drag){ .type = DragNone }; // Nothing pending is left for run() to apply
+	if (!apply)
+		return;
+	while (XCheckMaskEvent(display, EnterWindowMask, &ev));
+	if ((m = rectangleToMonitor(c->x, c->y, c->w, c->h)) != selectedMonitor) {
+		sendmon(c, m);
+        selectedMonitor = m;
+		focus(NULL);
 	}
-    w = barLayoutWidth = TEXTW(monitor->layoutSymbol);
-    drawSetColorScheme(draw, scheme[SchemeNorm]);
-	x = drw_text(draw, x, 0, w, barHeight, leftRightPad / 2, monitor->layoutSymbol, 0);
+}
 
-	if ((w = monitor->windowWidth - textWidth - x) > barHeight) {
-		if (n > 0) {
-            textWidth = TEXTW(monitor->selectedClient->name) + leftRightPad;
-			mw = (textWidth >= w || n == 1) ? 0 : (w - textWidth) / (n - 1);
+/* The drag timer fired, run() applies the pending position once the queue is empty */
+void
+dragexpired(void)
+{
+	uint64_t expirations;
 
-			i = 0;
-			for (c = monitor->clients; c; c = c->next) {
-				if (!ISVISIBLE(c) || c == monitor->selectedClient)
-					continue;
-                textWidth = TEXTW(c->name);
-				if(textWidth < mw)
-					ew += (mw - textWidth);
-				else
-					i++;
-			}
-			if (i > 0)
-				mw += ew / i;
+	if (read(dragTimerFd, &expirations, sizeof(expirations)) < 0)
+		; /* already drained */
+	dragDue = 0;
+}
 
-			for (c = monitor->clients; c; c = c->next) {
-				if (!ISVISIBLE(c))
-					continue;
-                textWidth = MIN(monitor->selectedClient == c ? w : mw, TEXTW(c->name));
+/* Microseconds between two updates of the drag in progress */
+long long
+draginterval(void)
+{
+	return 1000000LL / (dragRate ? dragRate : MAX(drag.client->monitor->refreshRate, 1));
+}
 
-                drawSetColorScheme(draw, scheme[monitor->selectedClient == c ? SchemeSel : SchemeNorm]);
-				if (textWidth > 0) /* trap special handling of 0 in drw_text */
-					drw_text(draw, x, 0, textWidth, barHeight, leftRightPad / 2, c->name, 0);
-				if (c->isFloating)
-					drw_rect(draw, x + boxs, boxs, boxw, boxw, c->isFixed, 0);
-				x += textWidth;
-				w -= textWidth;
-			}
+/* Make sure the drag timer fires at due (a now() timestamp) */
+void
+dragtimer(long long due)
+{
+	struct itimerspec its = { { 0, 0 }, { due / 1000000, due % 1000000 * 1000 } };
+
+	if (dragDue == due)
+		return;
+	dragDue = due;
+	timerfd_settime(dragTimerFd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* Apply the latest pointer position to the client being moved or resized */
+void
+dragupdate(void)
+{
+	int nx, ny, nw, nh;
+	long long latency;
+	Client *c = drag.client;
+	Monitor *m = c->monitor;
+
+	drag.lastUpdate = now();
+	latency = drag.lastUpdate - drag.pendingSince;
+	dragStats.latency += latency;
+	dragStats.maxLatency = MAX(dragStats.maxLatency, latency);
+	drag.updates++;
+	drag.pending = 0;
+	if (drag.type == DragMove) {
+		nx = drag.originX + (drag.x - drag.startX);
+		ny = drag.originY + (drag.y - drag.startY);
+		if (abs(m->windowX - nx) < snap)
+			nx = m->windowX;
+		else if (abs((m->windowX + m->windowWidth) - (nx + WIDTH(c))) < snap)
+			nx = m->windowX + m->windowWidth - WIDTH(c);
+		if (abs(m->windowY - ny) < snap)
+			ny = m->windowY;
+		else if (abs((m->windowY + m->windowHeight) - (ny + HEIGHT(c))) < snap)
+			ny = m->windowY + m->windowHeight - HEIGHT(c);
+		if (!c->isFloating && m->layouts[m->selectedLayout]->arrange
+            && (abs(nx - c->x) > snap || abs(ny - c->y) > snap)) {
+			c->isFloating = 1;
+			arrange(m);
+		}
+		if (!m->layouts[m->selectedLayout]->arrange || c->isFloating)
+			resize(c, nx, ny, c->w, c->h, 1);
+	} else {
+		nw = MAX(drag.x - drag.originX - 2 * c->borderWidth + 1, 1);
+		nh = MAX(drag.y - drag.originY - 2 * c->borderWidth + 1, 1);
+		if (!c->isFloating && m->layouts[m->selectedLayout]->arrange
+            && m->windowX + nw <= m->windowX + m->windowWidth && m->windowY + nh <= m->windowY + m->windowHeight
+            && (abs(nw - c->w) > snap || abs(nh - c->h) > snap)) {
+			c->isFloating = 1;
+			arrange(m);
+		}
+		nx = c->x;
+		ny = c->y;
+		if ((!m->layouts[m->selectedLayout]->arrange || c->isFloating)
+		&& applysizehints(c, &nx, &ny, &nw, &nh, 1)) {
+			if (drag.syncCounter)
+				syncrequest(c);
+			resizeclient(c, nx, ny, nw, nh);
 		}
-        drawSetColorScheme(draw, scheme[SchemeNorm]);
-		drw_rect(draw, x, 0, w, barHeight, 1, 1);
 	}
-	drw_map(draw, monitor->barWindow, 0, 0, monitor->windowWidth, barHeight);
+}
+
+void drawBar(Monitor *monitor) {
+	BarSnapshot *s;
+
+	if (!monitor->showBar)
+		return;
+	barLayoutWidth = TEXTW(monitor->layoutSymbol);
+	if (monitor == selectedMonitor)
+		statusDrawnWidth = statusWidth;
+	s = barsnapshot(monitor);
+	if (nBarWorkers)
+		postbar(&barWorkers[monitor->barWorker % nBarWorkers], s);
+	else {
+		renderbar(draw, scheme, s);
+		free(s);
+	}
 }
 
 void drawBars(void) {
@@ -790,6 +1654,24 @@ void drawBars(void) {
         drawBar(monitor);
 }
 
+/* Redraw just the status text while it keeps the width it was laid out with */
+void
+drawstatus(void)
+{
+	Monitor *m = selectedMonitor;
+	int w = statusWidth;
+
+	if (!m->showBar)
+		return;
+	if (nBarWorkers || w != statusDrawnWidth || m->windowWidth - w < tagsWidth + barLayoutWidth) {
+		drawBar(m);
+		return;
+	}
+	drawSetColorScheme(draw, scheme[SchemeNorm]);
+	drw_text(draw, m->windowWidth - w, 0, w, barHeight, 0, statusText, 0);
+	drw_map(draw, m->barWindow, m->windowWidth - w, 0, w, barHeight);
+}
+
 void dwindle(Monitor *mon) {
     unsigned int i, n, nx, ny, nw, nh;
     Client *c;
@@ -843,8 +1725,16 @@ enternotify(XEvent *e)
 	Monitor *m;
 	XCrossingEvent *ev = &e->xcrossing;
 
+	/* the root hears about every move over itself and the bars, but a
+	 * client keeps the moves inside it to itself */
+	if ((pointerKnown = ev->same_screen && ev->window == root)) {
+		pointerX = ev->x_root;
+		pointerY = ev->y_root;
+	}
 	if ((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root)
 		return;
+	if (drag.type != DragNone)
+		return;
 	c = windowToClient(ev->window);
 	m = c ? c->monitor : windowToMonitor(ev->window);
 	if (m != selectedMonitor) {
@@ -855,6 +1745,30 @@ enternotify(XEvent *e)
 	focus(c);
 }
 
+/* Expand a leading ~/ to $HOME and a leading $NAME/ to that variable, such
+ * as $XDG_RUNTIME_DIR; unset variables are left alone. The result is to be freed */
+char *
+expandpath(const char *path)
+{
+	const char *prefix = NULL;
+	char name[64], *s;
+	size_t n;
+
+	if (!strncmp(path, "~/", 2) && (prefix = getenv("HOME"))) {
+		path++;
+	} else if (path[0] == '$' && (n = strcspn(path + 1, "/")) < sizeof(name)) {
+		memcpy(name, path + 1, n);
+		name[n] = '\0';
+		if ((prefix = getenv(name)))
+			path += n + 1;
+	}
+	if (!prefix)
+		prefix = "";
+	s = ecalloc(strlen(prefix) + strlen(path) + 1, 1);
+	sprintf(s, "%s%s", prefix, path);
+	return s;
+}
+
 void
 expose(XEvent *e)
 {
@@ -865,6 +1779,36 @@ expose(XEvent *e)
         drawBar(m);
 }
 
+/* Fetch the titles whose rate limit has run out */
+void
+flushtitles(void)
+{
+	uint64_t expirations;
+	long long t = now(), due, next = 0;
+	Client *c;
+	Monitor *m;
+
+	if (read(titleTimerFd, &expirations, sizeof(expirations)) < 0)
+		; /* already drained */
+	titlesDue = 0;
+	for (m = monitors; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			if (!c->titleDirty)
+				continue;
+			due = c->cold.titleFetched + titleUpdateInterval * 1000LL;
+			if (due > t) {
+				next = next ? MIN(next, due) : due;
+				continue;
+			}
+			c->titleDirty = 0;
+			c->cold.titleFetched = t;
+			if (updatetitle(c) && ISVISIBLE(c))
+				drawBar(m);
+		}
+	if (next)
+		titletimer(next);
+}
+
 void focus(Client *client) {
     /* If no client or an invisible client was passed, set client to the selection-next visible client */
     if (!client || !ISVISIBLE(client)) {
@@ -916,9 +1860,11 @@ focusmon(const Argument *arg)
 	focus(NULL);
 }
 
-/* Set the focus on the next/previous client, depending on whether argument->i is positive or not */
+/* Set the focus on the next/previous client, depending on whether argument->i is positive or not.
+ * |argument->i| is the number of steps, so coalesced key repeats cost a single focus and restack */
 void focusStack(const Argument *argument) {
-	Client *client = NULL, *i;
+	Client *client, *next, *i;
+	int steps;
 
     if (!selectedMonitor->selectedClient) { // If the selected monitor does not contain any selected client
         return;
@@ -926,33 +1872,86 @@ void focusStack(const Argument *argument) {
     if (selectedMonitor->selectedClient->isFullscreen && lockFullscreen) { // If the selected client is on fullscreen
         return;
     }
-	if (argument->i > 0) {
-        /* Find the next visible client in the stack, starting from the currently selected one */
-		for (client = selectedMonitor->selectedClient->next; client && !ISVISIBLE(client); client = client->next);
-		if (!client) // If there is no client found (selectedClient may not have a next (?))
-            /* Find the first visible client in the monitor */
-			for (client = selectedMonitor->clients; client && !ISVISIBLE(client); client = client->next);
-	} else {
-        /* Iterate through the current monitor's (visible) clients until the next client is the currently selected client */
-        for (i = selectedMonitor->clients; i != selectedMonitor->selectedClient; i = i->next) {
-            if (ISVISIBLE(i)) {
-                client = i;
-            }
-        }
-        if (!client) {
-            for (; i; i = i->next) {
-                if (ISVISIBLE(i)) {
-                    client = i;
-                }
-            }
-        }
+	client = selectedMonitor->selectedClient;
+	for (steps = MAX(abs(argument->i), 1); steps > 0; steps--) {
+		next = NULL;
+		if (argument->i > 0) {
+			/* Find the next visible client in the stack, starting from the current one */
+			for (next = client->next; next && !ISVISIBLE(next); next = next->next);
+			if (!next) // If there is no client found (client may not have a next (?))
+				/* Find the first visible client in the monitor */
+				for (next = selectedMonitor->clients; next && !ISVISIBLE(next); next = next->next);
+		} else {
+			/* Iterate through the current monitor's (visible) clients until the next client is the current one */
+			for (i = selectedMonitor->clients; i != client; i = i->next) {
+				if (ISVISIBLE(i)) {
+					next = i;
+				}
+			}
+			if (!next) {
+				for (; i; i = i->next) {
+					if (ISVISIBLE(i)) {
+						next = i;
+					}
+				}
+			}
+		}
+		if (!next)
+			break;
+		client = next;
 	}
-	if (client) {
+	if (client != selectedMonitor->selectedClient) {
 		focus(client);
 		restack(selectedMonitor);
 	}
 }
 
+void
+freebarworker(BarWorker *w)
+{
+	int i;
+	BarSnapshot *s, *next;
+
+	for (s = w->queue; s; s = next) {
+		next = s->next;
+		free(s);
+	}
+	for (i = 0; i < LENGTH(colors); i++)
+		free(w->scheme[i]);
+	free(w->scheme);
+	drw_free(w->draw);
+	XCloseDisplay(w->display);
+	pthread_cond_destroy(&w->wake);
+	pthread_mutex_destroy(&w->lock);
+}
+
+void
+freeconfig(Config *cf)
+{
+	if (!cf)
+		return;
+	munmap(cf->map, cf->size);
+	free(cf->rules);
+	free(cf->keys);
+	free(cf->buttons);
+	free(cf->argv);
+	free(cf);
+}
+
+void
+freerules(void)
+{
+	size_t i;
+
+	for (i = 0; i < LENGTH(ruleSet.field); i++)
+		match_free(ruleSet.field[i]);
+	free(ruleSet.need);
+	free(ruleSet.seen);
+	free(ruleSet.always);
+	free(ruleSet.matched);
+	free(ruleSet.monitor);
+}
+
 Atom
 getatomprop(Client *c, Atom prop)
 {
@@ -969,14 +1968,15 @@ getatomprop(Client *c, Atom prop)
 	return atom;
 }
 
+/* Root pointer position as of the last pointer event, the server is only asked when it is unknown */
 int
 getRootPointer(int *x, int *y)
 {
-	int di;
-	unsigned int dui;
-	Window dummy;
-
-	return XQueryPointer(display, root, &dummy, &dummy, x, y, &di, &di, &dui);
+	if (!pointerKnown)
+		return queryRootPointer(x, y);
+	*x = pointerX;
+	*y = pointerY;
+	return 1;
 }
 
 long getState(Window window) {
@@ -999,62 +1999,121 @@ int
 gettextprop(Window w, Atom atom, char *text, unsigned int size)
 {
 	char **list = NULL;
-	int n;
+	int n, format;
+	unsigned char *data = NULL;
+	unsigned long len, nitems, after;
+	Atom type;
 	XTextProperty name;
 
 	if (!text || size == 0)
 		return 0;
 	text[0] = '\0';
-	if (!XGetTextProperty(display, w, &name, atom) || !name.nitems)
+	/* fetch no more than fits in text, however long the property is */
+	if (XGetWindowProperty(display, w, atom, 0, (size + 3) / 4, False, AnyPropertyType,
+	                       &type, &format, &nitems, &after, &data) != Success || !data)
 		return 0;
-	if (name.encoding == XA_STRING)
-		strncpy(text, (char *)name.value, size - 1);
-	else {
+	if (format != 8 || !nitems) {
+		XFree(data);
+		return 0;
+	}
+	/* compound text spends up to four bytes on a character, so it is
+	 * refetched with room for that and cut back to a whole character */
+	if (after && type != XA_STRING && type != utf8String) {
+		XFree(data);
+		data = NULL;
+		if (XGetWindowProperty(display, w, atom, 0, MIN(nitems + after + 3, 4UL * size + 3) / 4, False, type,
+		                       &type, &format, &nitems, &after, &data) != Success || !data)
+			return 0;
+		if (format == 8 && after)
+			nitems = ctprefix(data, nitems);
+		if (format != 8 || !nitems) {
+			XFree(data);
+			return 0;
+		}
+	}
+	if (type == XA_STRING || type == utf8String) {
+		/* UTF8_STRING needs no locale conversion, STRING was never converted */
+		len = MIN(nitems, size - 1);
+		if (type == utf8String && len < nitems)
+			while (len > 0 && ((unsigned char)data[len] & 0xc0) == 0x80)
+				len--; /* do not cut a character in half */
+		memcpy(text, data, len);
+		text[len] = '\0';
+	} else {
+		name.value = data;
+		name.encoding = type;
+		name.format = format;
+		name.nitems = nitems;
 		if (XmbTextPropertyToTextList(display, &name, &list, &n) >= Success && n > 0 && *list) {
 			strncpy(text, *list, size - 1);
 			XFreeStringList(list);
 		}
+		text[size - 1] = '\0';
 	}
-	text[size - 1] = '\0';
-	XFree(name.value);
+	XFree(data);
 	return 1;
 }
 
+/* numlockmask is cached, it is only recomputed on MappingNotify */
 void grabButtons(Client *c, int focused) {
-	updatenumlockmask();
-	{
-		unsigned int i, j;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		XUngrabButton(display, AnyButton, AnyModifier, c->window);
-		if (!focused)
-			XGrabButton(display, AnyButton, AnyModifier, c->window, False,
-                        BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
-		for (i = 0; i < LENGTH(buttons); i++)
-			if (buttons[i].click == ClickClientWindow)
-				for (j = 0; j < LENGTH(modifiers); j++)
-					XGrabButton(display, buttons[i].button,
-						buttons[i].mask | modifiers[j],
-                                c->window, False, BUTTONMASK,
-                                GrabModeAsync, GrabModeSync, None, None);
-	}
+	unsigned int i, j;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+
+	XUngrabButton(display, AnyButton, AnyModifier, c->window);
+	if (!focused)
+		XGrabButton(display, AnyButton, AnyModifier, c->window, False,
+                    BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
+	for (i = 0; i < nbuttons; i++)
+		if (activeButtons[i].click == ClickClientWindow)
+			for (j = 0; j < LENGTH(modifiers); j++)
+				XGrabButton(display, activeButtons[i].button,
+					activeButtons[i].mask | modifiers[j],
+                            c->window, False, BUTTONMASK,
+                            GrabModeAsync, GrabModeSync, None, None);
 }
 
+/* Grab all keys and rebuild the keycode dispatch table used by keyPress() */
 void
 grabkeys(void)
 {
-	updatenumlockmask();
-	{
-		unsigned int i, j;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		KeyCode code;
+	unsigned int i, j, n = 0, size = 0;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	int k, start, end, skip, level, step;
+	KeySym *syms;
 
-		XUngrabKey(display, AnyKey, AnyModifier, root);
-		for (i = 0; i < LENGTH(keys); i++)
-			if ((code = XKeysymToKeycode(display, keys[i].keySymbol)))
-				for (j = 0; j < LENGTH(modifiers); j++)
-					XGrabKey(display, code, keys[i].modifier | modifiers[j], root,
-                             True, GrabModeAsync, GrabModeAsync);
+	XUngrabKey(display, AnyKey, AnyModifier, root);
+	memset(keyIndex, 0, sizeof keyIndex);
+	XDisplayKeycodes(display, &start, &end);
+	end = MIN(end, (int)LENGTH(keyIndex) - 2);
+	if (!(syms = XGetKeyboardMapping(display, start, end - start + 1, &skip)))
+		return;
+	/* A key is bound on every keycode that has its keysym in the first or
+	 * second group, so it keeps working across layouts. Only the base level
+	 * counts, and the shifted one for bindings that include Shift, so Mod+1
+	 * never fires a binding of Mod+exclam. The core mapping lists group 1
+	 * base, shifted, then group 2 base, shifted. Walking the keycodes in
+	 * order leaves the bindings grouped by keycode, in the order of the keys. */
+	for (k = 0; k < (int)LENGTH(keyIndex) - 1; k++) {
+		keyIndex[k] = n;
+		for (i = 0; k >= start && k <= end && i < nkeys; i++) {
+			if (!activeKeys[i].function || activeKeys[i].keySymbol == NoSymbol)
+				continue;
+			step = activeKeys[i].modifier & ShiftMask ? 1 : 2;
+			for (level = 0; level < MIN(skip, 4) && syms[(k - start) * skip + level] != activeKeys[i].keySymbol;
+			     level += step);
+			if (level >= MIN(skip, 4))
+				continue;
+			if (n == size && !(keyBindings = realloc(keyBindings, (size = size ? size * 2 : 64) * sizeof(KeyBinding))))
+				die("realloc:");
+			keyBindings[n].modifier = CLEANMASK(activeKeys[i].modifier);
+			keyBindings[n++].key = &activeKeys[i];
+			for (j = 0; j < LENGTH(modifiers); j++)
+				XGrabKey(display, k, activeKeys[i].modifier | modifiers[j], root,
+                         True, GrabModeAsync, GrabModeAsync);
+		}
 	}
+	keyIndex[k] = n;
+	XFree(syms);
 }
 
 void
@@ -1064,6 +2123,19 @@ incnmaster(const Argument *arg)
 	arrange(selectedMonitor);
 }
 
+/* Note a change of c in the journal; this only writes to memory */
+void
+journalclient(Client *c, int gone)
+{
+	JournalRecord r;
+
+	recordclient(c, &r);
+	if (gone)
+		r.flags |= JOURNAL_GONE;
+	if (journal_write(&r))
+		journalCompactDue = 1;
+}
+
 #ifdef XINERAMA
 static int
 isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
@@ -1078,14 +2150,33 @@ isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 
 void keyPress(XEvent *event) {
 	XKeyEvent *keyEvent = &event->xkey; // Get the key-press event
-    KeySym keySymbol = XKeycodeToKeysym(display, (KeyCode) keyEvent->keycode, 0); // Get the keycode of the keypress event
-    for (unsigned int i = 0; i < LENGTH(keys); i++) { // Iterate through the Keys defined in config.h
-        if (keySymbol == keys[i].keySymbol // If the key symbol matches de key symbol of any Key
-            && CLEANMASK(keys[i].modifier) == CLEANMASK(keyEvent->state) // The modifier matches too
-            && keys[i].function) { // The Key's function is proper
-            keys[i].function(&(keys[i].argument)); // Run the Key's function with the Key's argument
-        }
-    }
+	unsigned int i, j, repeats = 0, modifier = CLEANMASK(keyEvent->state);
+	const Key *key;
+	Argument argument;
+
+	if (keyEvent->keycode >= LENGTH(keyIndex) - 1)
+		return;
+	/* Only the bindings grabbed for this keycode are candidates, see grabkeys() */
+	for (i = keyIndex[keyEvent->keycode]; i < keyIndex[keyEvent->keycode + 1]; i++) {
+		if (keyBindings[i].modifier != modifier)
+			continue;
+		key = keyBindings[i].key;
+		for (j = 0; j < LENGTH(repeatable) && key->function != repeatable[j]; j++);
+		if (j == LENGTH(repeatable)) {
+			key->function(&key->argument); // Run the Key's function with the Key's argument
+			continue;
+		}
+		/* Collapse a held key into one step of repeats times the size */
+		if (!repeats)
+			repeats = countrepeats(keyEvent);
+		argument = key->argument;
+		if (key->function == setmfact) {
+			if (argument.f < 1.0)
+				argument.f = MAX(-0.9f, MIN(0.9f, argument.f * repeats));
+		} else
+			argument.i *= repeats;
+		key->function(&argument);
+	}
 }
 
 void
@@ -1104,19 +2195,120 @@ killclient(const Argument *arg)
 	}
 }
 
+/* The pointer left the root for a client or another screen */
+void
+leavenotify(XEvent *e)
+{
+	pointerKnown = 0;
+}
+
+/* Map a config file written by dwmrc and build the tables from it. Nothing in
+ * it is trusted: a file that is cut short, points outside itself or names an
+ * unknown function or layout is rejected as a whole. */
+Config *
+loadconfig(const char *path)
+{
+	Config *cf;
+	const RcHeader *h;
+	const RcRule *rr;
+	const RcKey *rk;
+	const RcButton *rb;
+	const char *strings, **argv;
+	struct stat st;
+	size_t i, j, n, nargv = 0;
+	int fd, ok = 1;
+	void *map;
+	void (*function)(const Argument *);
+	Argument argument;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		fprintf(stderr, "dwm: cannot open config file %s\n", path);
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(RcHeader)
+	|| (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		fprintf(stderr, "dwm: invalid config file %s\n", path);
+		return NULL;
+	}
+	close(fd);
+	h = map;
+	if (h->magic != RC_MAGIC || h->version != RC_VERSION || !h->nstrings
+	|| (uint64_t)st.st_size != sizeof(RcHeader) + (uint64_t)h->nrules * sizeof(RcRule)
+	   + (uint64_t)h->nkeys * sizeof(RcKey) + (uint64_t)h->nbuttons * sizeof(RcButton) + h->nstrings
+	|| ((const char *)map)[st.st_size - 1]) {
+		munmap(map, st.st_size);
+		fprintf(stderr, "dwm: invalid config file %s\n", path);
+		return NULL;
+	}
+	rr = (const RcRule *)(h + 1);
+	rk = (const RcKey *)(rr + h->nrules);
+	rb = (const RcButton *)(rk + h->nkeys);
+	strings = (const char *)(rb + h->nbuttons);
+	n = h->nstrings;
+
+	cf = ecalloc(1, sizeof(Config));
+	cf->map = map;
+	cf->size = st.st_size;
+	/* all command vectors share one array, sized first */
+	for (i = 0; i < h->nkeys; i++)
+		if (rk[i].argument.type == RcArgCommand) {
+			ok &= (j = rccommand(strings, n, rk[i].argument.v.command)) > 0;
+			nargv += j + 1;
+		}
+	for (i = 0; i < h->nbuttons; i++)
+		if (rb[i].argument.type == RcArgCommand) {
+			ok &= (j = rccommand(strings, n, rb[i].argument.v.command)) > 0;
+			nargv += j + 1;
+		}
+	cf->argv = argv = ecalloc(MAX(nargv, 1), sizeof(char *));
+
+	cf->rules = ecalloc(MAX(h->nrules, 1), sizeof(Rule));
+	for (i = 0; ok && i < h->nrules; i++) {
+		ok = rcstring(strings, n, rr[i].class, &cf->rules[i].class)
+		     && rcstring(strings, n, rr[i].instance, &cf->rules[i].instance)
+		     && rcstring(strings, n, rr[i].title, &cf->rules[i].title);
+		cf->rules[i].tags = rr[i].tags;
+		cf->rules[i].isfloating = rr[i].isfloating;
+		cf->rules[i].monitor = rr[i].monitor;
+	}
+	/* Key and Button hold a const Argument, so they are copied in whole */
+	cf->keys = ecalloc(MAX(h->nkeys, 1), sizeof(Key));
+	for (i = 0; ok && i < h->nkeys; i++)
+		if ((ok = (function = rcfunction(strings, n, rk[i].function, rk[i].argument.type))
+		          && rcargument(&rk[i].argument, strings, n, &argv, &argument)))
+			memcpy(&cf->keys[i], &(Key){ rk[i].modifier, rk[i].keysym, function, argument }, sizeof(Key));
+	cf->buttons = ecalloc(MAX(h->nbuttons, 1), sizeof(Button));
+	for (i = 0; ok && i < h->nbuttons; i++)
+		if ((ok = rb[i].click < ClkLast
+		          && (function = rcfunction(strings, n, rb[i].function, rb[i].argument.type))
+		          && rcargument(&rb[i].argument, strings, n, &argv, &argument)))
+			memcpy(&cf->buttons[i], &(Button){ rb[i].click, rb[i].mask, rb[i].button, function, argument },
+			       sizeof(Button));
+	if (!ok) {
+		freeconfig(cf);
+		fprintf(stderr, "dwm: invalid config file %s\n", path);
+		return NULL;
+	}
+	cf->nrules = h->nrules;
+	cf->nkeys = h->nkeys;
+	cf->nbuttons = h->nbuttons;
+	return cf;
+}
+
 void manage(Window window, XWindowAttributes *windowAttributes) {
 	Client *c, *t = NULL;
 	Window trans = None;
 	XWindowChanges windowChanges;
 
-	c = ecalloc(1, sizeof(Client));
+	c = pool_alloc(&clientpool);
 	c->window = window;
 	/* geometry */
-	c->x = c->oldx = windowAttributes->x;
-	c->y = c->oldy = windowAttributes->y;
-	c->w = c->oldw = windowAttributes->width;
-	c->h = c->oldh = windowAttributes->height;
-	c->oldBorderWidth = windowAttributes->border_width;
+	c->x = c->cold.oldx = windowAttributes->x;
+	c->y = c->cold.oldy = windowAttributes->y;
+	c->w = c->cold.oldw = windowAttributes->width;
+	c->h = c->cold.oldh = windowAttributes->height;
+	c->cold.oldBorderWidth = windowAttributes->border_width;
 
 	updatetitle(c);
 	if (XGetTransientForHint(display, window, &trans) && (t = windowToClient(trans))) {
@@ -1126,6 +2318,8 @@ void manage(Window window, XWindowAttributes *windowAttributes) {
 		c->monitor = selectedMonitor;
 		applyrules(c);
 	}
+	if (nJournalReplay)
+		restoreclient(c);
 
 	if (c->x + WIDTH(c) > c->monitor->monitorX + c->monitor->monitorWidth)
 		c->x = c->monitor->monitorX + c->monitor->monitorWidth - WIDTH(c);
@@ -1162,6 +2356,7 @@ void manage(Window window, XWindowAttributes *windowAttributes) {
 	arrange(c->monitor);
 	XMapWindow(display, c->window);
 	focus(NULL);
+	journalclient(c, 0);
 }
 
 void
@@ -1170,8 +2365,8 @@ mappingnotify(XEvent *e)
 	XMappingEvent *ev = &e->xmapping;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
-		grabkeys();
+	if (ev->request == MappingModifier || ev->request == MappingKeyboard)
+		updatekeyboard();
 }
 
 void
@@ -1208,9 +2403,24 @@ void motionNotify(XEvent *e) { // Movement of the mouse
 	Monitor *m;
 	XMotionEvent *ev = &e->xmotion;
 
+	pointerX = ev->x_root;
+	pointerY = ev->y_root;
+	pointerKnown = 1;
+	if (drag.type != DragNone) {
+		drag.x = ev->x_root;
+		drag.y = ev->y_root;
+		if (!drag.pending) {
+			drag.pending = 1;
+			drag.pendingSince = now();
+		}
+		/* at most one geometry update per frame, run() applies the rest */
+		if (drag.pendingSince >= dragdue())
+			dragupdate();
+		return;
+	}
 	if (ev->window != root)
 		return;
-	if ((m = rectangleToMonitor(ev->x_root, ev->y_root, 1, 1)) != mon && mon) {
+	if ((m = pointToMonitor(ev->x_root, ev->y_root)) != mon && mon) {
 		unfocus(selectedMonitor->selectedClient, 1);
         selectedMonitor = m;
 		focus(NULL);
@@ -1218,64 +2428,27 @@ void motionNotify(XEvent *e) { // Movement of the mouse
 	mon = m;
 }
 
+/* Start moving the selected client, motionNotify() and buttonRelease() do the rest */
 void
 movemouse(const Argument *arg)
 {
-	int x, y, ocx, ocy, nx, ny;
+	int x, y;
 	Client *c;
-	Monitor *m;
-	XEvent ev;
-	Time lasttime = 0;
 
-	if (!(c = selectedMonitor->selectedClient))
+	if (!(c = selectedMonitor->selectedClient) || drag.type != DragNone)
 		return;
 	if (c->isFullscreen) /* no support moving fullscreen windows by mouse */
 		return;
 	restack(selectedMonitor);
-	ocx = c->x;
-	ocy = c->y;
 	if (XGrabPointer(display, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
                      None, cursor[CurMove]->cursor, CurrentTime) != GrabSuccess)
 		return;
-	if (!getRootPointer(&x, &y))
+	if (!queryRootPointer(&x, &y)) {
+		XUngrabPointer(display, CurrentTime);
 		return;
-	do {
-		XMaskEvent(display, MOUSEMASK | ExposureMask | SubstructureRedirectMask, &ev);
-		switch(ev.type) {
-		case ConfigureRequest:
-		case Expose:
-		case MapRequest:
-			handler[ev.type](&ev);
-			break;
-		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
-				continue;
-			lasttime = ev.xmotion.time;
-
-			nx = ocx + (ev.xmotion.x - x);
-			ny = ocy + (ev.xmotion.y - y);
-			if (abs(selectedMonitor->windowX - nx) < snap)
-				nx = selectedMonitor->windowX;
-			else if (abs((selectedMonitor->windowX + selectedMonitor->windowWidth) - (nx + WIDTH(c))) < snap)
-				nx = selectedMonitor->windowX + selectedMonitor->windowWidth - WIDTH(c);
-			if (abs(selectedMonitor->windowY - ny) < snap)
-				ny = selectedMonitor->windowY;
-			else if (abs((selectedMonitor->windowY + selectedMonitor->windowHeight) - (ny + HEIGHT(c))) < snap)
-				ny = selectedMonitor->windowY + selectedMonitor->windowHeight - HEIGHT(c);
-			if (!c->isFloating && selectedMonitor->layouts[selectedMonitor->selectedLayout]->arrange
-                && (abs(nx - c->x) > snap || abs(ny - c->y) > snap))
-				togglefloating(NULL);
-			if (!selectedMonitor->layouts[selectedMonitor->selectedLayout]->arrange || c->isFloating)
-				resize(c, nx, ny, c->w, c->h, 1);
-			break;
-		}
-	} while (ev.type != ButtonRelease);
-	XUngrabPointer(display, CurrentTime);
-	if ((m = rectangleToMonitor(c->x, c->y, c->w, c->h)) != selectedMonitor) {
-		sendmon(c, m);
-        selectedMonitor = m;
-		focus(NULL);
 	}
+	drag = (Drag){ .type = DragMove, .client = c, .originX = c->x, .originY = c->y,
+	               .startX = x, .startY = y, .x = x, .y = y, .started = now() };
 }
 
  Client *
@@ -1295,6 +2468,51 @@ nexttiled(Client *c)
 	return c;
 }
 
+/* Monotonic clock in microseconds */
+long long
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* Same as rectangleToMonitor(x, y, 1, 1) in O(log m) */
+Monitor *
+pointToMonitor(int x, int y)
+{
+	int lo, hi, mid, i, j;
+	Monitor *m = monitorMap.last;
+
+	if (!monitorMap.dirty && m && x >= m->windowX && x < m->windowX + m->windowWidth
+	&& y >= m->windowY && y < m->windowY + m->windowHeight)
+		return m;
+	if (monitorMap.dirty)
+		updatemonitormap();
+	/* find the cell edges left of and above the point */
+	for (lo = 0, hi = monitorMap.nx; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (monitorMap.xs[mid] <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	i = lo - 1;
+	for (lo = 0, hi = monitorMap.ny; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (monitorMap.ys[mid] <= y)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	j = lo - 1;
+	if (i < 0 || i >= monitorMap.nx - 1 || j < 0 || j >= monitorMap.ny - 1
+	|| !(m = monitorMap.cells[j * (monitorMap.nx - 1) + i]))
+		return selectedMonitor;
+	return monitorMap.last = m;
+}
+
 void
 pop(Client *c)
 {
@@ -1304,6 +2522,72 @@ pop(Client *c)
 	arrange(c->monitor);
 }
 
+/* Hand a snapshot to its renderer, replacing one it has not drawn yet */
+void
+postbar(BarWorker *w, BarSnapshot *s)
+{
+	BarSnapshot **p;
+
+	pthread_mutex_lock(&w->lock);
+	for (p = &w->queue; *p && (*p)->window != s->window; p = &(*p)->next);
+	if (*p) {
+		s->next = (*p)->next;
+		free(*p);
+	}
+	*p = s;
+	pthread_cond_signal(&w->wake);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* Write the performance counters to stderr */
+void
+printstats(void)
+{
+	unsigned long i;
+	double lifetime;
+	Child *c;
+
+	fprintf(stderr, "dwm: clients: %zu live, %zu peak, %zu slabs\n",
+	        clientpool.live, clientpool.peak, clientpool.nslabs);
+	fprintf(stderr, "dwm: drags: %lu, %.1f updates/s, latency %lld us avg, %lld us max\n",
+	        dragStats.drags,
+	        dragStats.duration ? dragStats.updates * 1e6 / dragStats.duration : 0.0,
+	        dragStats.updates ? dragStats.latency / (long long)dragStats.updates : 0,
+	        dragStats.maxLatency);
+	fprintf(stderr, "dwm: status updates: %lu redrawn, %lu unchanged\n",
+	        statusStats.redrawn, statusStats.unchanged);
+	fprintf(stderr, "dwm: children: %lu spawned\n", nSpawned);
+	for (i = nSpawned > LENGTH(spawned) ? nSpawned - LENGTH(spawned) : 0; i < nSpawned; i++) {
+		c = &spawned[i % LENGTH(spawned)];
+		lifetime = ((c->ended ? c->ended : now()) - c->started) / 1e6;
+		if (!c->ended)
+			fprintf(stderr, "dwm:   %d %s: running for %.1f s\n", c->pid, c->name, lifetime);
+		else if (WIFSIGNALED(c->status))
+			fprintf(stderr, "dwm:   %d %s: killed by signal %d after %.1f s\n",
+			        c->pid, c->name, WTERMSIG(c->status), lifetime);
+		else
+			fprintf(stderr, "dwm:   %d %s: exited %d after %.1f s\n",
+			        c->pid, c->name, WEXITSTATUS(c->status), lifetime);
+	}
+}
+
+/* Collect every child that has exited, noting the ones spawn() recorded */
+void
+reapchildren(void)
+{
+	pid_t pid;
+	int status;
+	size_t i;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		for (i = 0; i < LENGTH(spawned); i++)
+			if (spawned[i].pid == pid && !spawned[i].ended) {
+				spawned[i].ended = now();
+				spawned[i].status = status;
+				break;
+			}
+}
+
 void
 propertynotify(XEvent *e)
 {
@@ -1311,9 +2595,10 @@ propertynotify(XEvent *e)
 	Window trans;
 	XPropertyEvent *ev = &e->xproperty;
 
-	if ((ev->window == root) && (ev->atom == XA_WM_NAME))
-		updatestatus();
-	else if (ev->state == PropertyDelete)
+	if ((ev->window == root) && (ev->atom == XA_WM_NAME)) {
+		if (statusfd < 0) /* the built-in status owns the text otherwise */
+			updatestatus();
+	} else if (ev->state == PropertyDelete)
 		return; /* ignore */
 	else if ((c = windowToClient(ev->window))) {
 		switch(ev->atom) {
@@ -1331,34 +2616,368 @@ propertynotify(XEvent *e)
                 drawBars();
 			break;
 		}
-		if (ev->atom == XA_WM_NAME || ev->atom == netAtom[NetWMName]) {
-			updatetitle(c);
-			if (c == c->monitor->selectedClient)
-                drawBar(c->monitor);
-		}
+		if (ev->atom == XA_WM_NAME || ev->atom == netAtom[NetWMName])
+			titlenotify(c);
 		if (ev->atom == netAtom[NetWMWindowType])
 			updatewindowtype(c);
 	}
 }
 
+/* Ask the server where the pointer is, refreshing the tracked position */
+int
+queryRootPointer(int *x, int *y)
+{
+	int di;
+	unsigned int dui;
+	Window dummy, child;
+
+	if (!XQueryPointer(display, root, &dummy, &child, x, y, &di, &di, &dui))
+		return pointerKnown = 0;
+	/* only cached while no client window hides the moves from us */
+	pointerKnown = !windowToClient(child);
+	pointerX = *x;
+	pointerY = *y;
+	return 1;
+}
+
+void
+quit(const Argument *arg)
+{
+	running = 0;
+}
+
+#ifdef XRANDR
+void
+randrnotify(XEvent *e)
+{
+	XEvent ev;
+	Monitor *m, **fresh;
+	int i, n = 0;
+
+	XRRUpdateConfiguration(e);
+	/* docking sends a burst of notifications, apply only the final layout */
+	while (XCheckTypedEvent(display, randrEventBase + RRScreenChangeNotify, &ev)
+	|| XCheckTypedEvent(display, randrEventBase + RRNotify, &ev))
+		XRRUpdateConfiguration(&ev);
+	if (DisplayWidth(display, screen) != screenWidth || DisplayHeight(display, screen) != screenHeight) {
+		pointerKnown = 0;
+		screenWidth = DisplayWidth(display, screen);
+		screenHeight = DisplayHeight(display, screen);
+		drw_resize(draw, screenWidth, barHeight);
+	}
+	if (updaterandr()) {
+		/* updaterandr() cannot arrange a monitor that has no bar yet, so
+		 * arrange the new ones here, including one that took the clients of
+		 * a removed output; the others were arranged if they changed */
+		for (m = monitors; m; m = m->next)
+			n++;
+		fresh = ecalloc(n, sizeof(Monitor *));
+		for (n = 0, m = monitors; m; m = m->next)
+			if (!m->barWindow)
+				fresh[n++] = m;
+		updatebars();
+		for (i = 0; i < n; i++)
+			arrange(fresh[i]);
+		free(fresh);
+	}
+	updaterefreshrates(); // A mode switch may change only the rate
+}
+#endif /* XRANDR */
+
+/* Convert an argument of a config file; commands take their words from the
+ * string table, counted and checked by rccommand() beforehand */
+int
+rcargument(const RcArgument *a, const char *strings, size_t n, const char ***argv, Argument *out)
+{
+	const char *s;
+
+	memset(out, 0, sizeof(*out));
+	switch (a->type) {
+	case RcArgNone:
+		return 1;
+	case RcArgInt:
+		out->i = a->v.i;
+		return 1;
+	case RcArgUint:
+		out->ui = a->v.ui;
+		return 1;
+	case RcArgFloat:
+		out->f = a->v.f;
+		return 1;
+	case RcArgLayout:
+		if (a->v.layout >= LENGTH(layouts))
+			return 0;
+		out->v = &layouts[a->v.layout];
+		return 1;
+	case RcArgDmenu: /* the compiled in one, spawn() fills in its monitor */
+		out->v = dmenuCommand;
+		return 1;
+	case RcArgCommand:
+		out->v = *argv;
+		for (s = strings + a->v.command; *s; s += strlen(s) + 1)
+			*(*argv)++ = s;
+		*(*argv)++ = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+/* Count the words of a command, 0 if it has none or is not terminated by an
+ * empty string inside the table */
+size_t
+rccommand(const char *strings, size_t n, uint32_t offset)
+{
+	const char *s;
+	size_t len, words = 0;
+
+	if (offset >= n)
+		return 0;
+	for (s = strings + offset; *s; s += len + 1, words++)
+		if ((size_t)(s - strings) + (len = strlen(s)) + 1 >= n)
+			return 0;
+	return words;
+}
+
+void
+(*rcfunction(const char *strings, size_t n, uint32_t offset, uint32_t type))(const Argument *)
+{
+	const char *name;
+	size_t i;
+
+	if (!rcstring(strings, n, offset, &name) || !name)
+		return NULL;
+	for (i = 0; i < LENGTH(functions) && strcmp(functions[i].name, name); i++);
+	if (i == LENGTH(functions)) {
+		fprintf(stderr, "dwm: unknown function %s\n", name);
+		return NULL;
+	}
+	/* spawn(NULL) or setlayout((Layout *)1) would crash us, not the file */
+	if (type > RcArgDmenu || !(functions[i].args & RC_ARG(type))) {
+		fprintf(stderr, "dwm: wrong argument for %s\n", name);
+		return NULL;
+	}
+	return functions[i].function;
+}
+
+/* The table ends in a NUL byte, so any offset inside it is a string */
+int
+rcstring(const char *strings, size_t n, uint32_t offset, const char **s)
+{
+	if (offset == RC_NONE)
+		*s = NULL;
+	else if (offset < n)
+		*s = strings + offset;
+	else
+		return 0;
+	return 1;
+}
+
+/* What the next session restores for c, see restoreclient(); fullscreen
+ * windows are recorded as they were before, the property brings it back */
+void
+recordclient(Client *c, JournalRecord *r)
+{
+	int fullscreen = c->isFullscreen;
+
+	*r = (JournalRecord){
+		.window = c->window, .tags = c->tags, .monitor = c->monitor->num,
+		.x = fullscreen ? c->cold.oldx : c->x, .y = fullscreen ? c->cold.oldy : c->y,
+		.w = fullscreen ? c->cold.oldw : c->w, .h = fullscreen ? c->cold.oldh : c->h,
+		.flags = (fullscreen ? c->oldState : c->isFloating) ? JOURNAL_FLOATING : 0,
+	};
+}
+
+Monitor *
+rectangleToMonitor(int x, int y, int w, int h)
+{
+	Monitor *m, *r = selectedMonitor;
+	int a, area = 0;
+
+	for (m = monitors; m; m = m->next)
+		if ((a = INTERSECT(x, y, w, h, m)) > area) {
+			area = a;
+			r = m;
+		}
+	return r;
+}
+
+/* Hand the session to a new instance of ourselves: write it to a file named
+ * by DWM_STATE, see adoptstate(), and exec. Returns only if that fails, with
+ * the session as it was. */
+void
+reexec(char *argv[])
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	char path[256];
+	StateHeader *h;
+	StateMonitor *sm;
+	StateClient *sc;
+	Client *c, **sorted;
+	Monitor *m;
+	size_t size, nmonitors = 0, nclients = 0, i, j;
+	int fd;
+	void *map;
+
+	for (m = monitors; m; m = m->next, nmonitors++)
+		for (c = m->clients; c; c = c->next)
+			nclients++;
+	size = sizeof(StateHeader) + nmonitors * sizeof(StateMonitor) + nclients * sizeof(StateClient);
+	if (snprintf(path, sizeof(path), "%s/dwm-state-XXXXXX", dir ? dir : "/tmp") >= (int)sizeof(path)
+	|| (fd = mkstemp(path)) < 0) {
+		fputs("dwm: cannot save the session for restart\n", stderr);
+		return;
+	}
+	if (ftruncate(fd, size) < 0
+	|| (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		unlink(path);
+		fputs("dwm: cannot save the session for restart\n", stderr);
+		return;
+	}
+	close(fd);
+
+	/* clients are stored in address order, so that lists can refer to them by index */
+	sorted = ecalloc(MAX(nclients, 1), sizeof(Client *));
+	for (m = monitors, i = 0; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			sorted[i++] = c;
+	qsort(sorted, nclients, sizeof(Client *), compareclient);
+	h = map;
+	*h = (StateHeader){ STATE_MAGIC, sizeof(StateHeader), sizeof(StateMonitor), sizeof(StateClient),
+	                    nmonitors, nclients, 0, 0 };
+	sm = (StateMonitor *)(h + 1);
+	sc = (StateClient *)(sm + nmonitors);
+	for (i = 0; i < nclients; i++) {
+		c = sorted[i];
+		sc[i] = (StateClient){
+			.window = c->window, .x = c->x, .y = c->y, .w = c->w, .h = c->h,
+			.borderWidth = c->borderWidth, .tags = c->tags,
+			.isFloating = c->isFloating, .isFullscreen = c->isFullscreen, .isUrgent = c->isUrgent,
+			.isFixed = c->isFixed, .neverFocus = c->neverFocus, .oldState = c->oldState,
+			.cold = c->cold,
+		};
+	}
+	for (m = monitors, i = 0; m; m = m->next, i++) {
+		if (m == selectedMonitor)
+			h->selectedMonitor = i;
+		sm[i] = (StateMonitor){
+			.masterFactor = m->masterFactor, .nMaster = m->nMaster, .showBar = m->showBar,
+			.selectedTags = m->selectedTags, .selectedLayout = m->selectedLayout,
+			.tagSet = { m->tagSet[0], m->tagSet[1] },
+			.layouts = { m->layouts[0] - layouts, m->layouts[1] - layouts },
+			.clients = stateindex(sorted, nclients, m->clients),
+			.stack = stateindex(sorted, nclients, m->stack),
+			.selectedClient = stateindex(sorted, nclients, m->selectedClient),
+		};
+		for (c = m->clients; c; c = c->next) {
+			j = stateindex(sorted, nclients, c);
+			sc[j].monitor = i;
+			sc[j].next = stateindex(sorted, nclients, c->next);
+		}
+		for (c = m->stack; c; c = c->selectionNext)
+			sc[stateindex(sorted, nclients, c)].selectionNext = stateindex(sorted, nclients, c->selectionNext);
+	}
+	free(sorted);
+	munmap(map, size);
+
+	XSync(display, False);
+	fcntl(ConnectionNumber(display), F_SETFD, FD_CLOEXEC); /* the new process opens its own */
+	setenv("DWM_STATE", path, 1);
+	execvp(argv[0], argv);
+	fputs("dwm: cannot restart, ", stderr);
+	perror(argv[0]);
+	unsetenv("DWM_STATE");
+	unlink(path);
+}
+
+/* Swap in the rules and bindings of the config file and rebuild the rule
+ * matcher, key dispatch table and button grabs; windows are left alone and
+ * the tables in use stay if the file does not load */
 void
-quit(const Argument *arg)
+reloadconfig(void)
 {
-	running = 0;
+	Config *old = config, *cf;
+	Client *c;
+	Monitor *m;
+
+	if (!configPath || !(cf = loadconfig(configPath)))
+		return;
+	setconfig(cf);
+	freerules();
+	compilerules();
+	grabkeys();
+	for (m = monitors; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			grabButtons(c, c == selectedMonitor->selectedClient);
+	freeconfig(old);
 }
 
-Monitor *
-rectangleToMonitor(int x, int y, int w, int h)
+/* Draw a bar snapshot with the given drawable, on whichever thread owns it */
+void
+renderbar(Draw *d, Color **scm, const BarSnapshot *s)
 {
-	Monitor *m, *r = selectedMonitor;
-	int a, area = 0;
+	int i, k, x, w, textWidth = 0, mw, ew = 0;
+	const unsigned int boxs = d->fonts->height / 9;
+	const unsigned int boxw = d->fonts->height / 6 + 2;
+	unsigned int t;
+	const BarTitle *title;
 
-	for (m = monitors; m; m = m->next)
-		if ((a = INTERSECT(x, y, w, h, m)) > area) {
-			area = a;
-			r = m;
+	/* Draw status first, so it can be overdrawn by tags later */
+	if (s->showStatus) { /* Status is only drawn on selected monitor */
+		drawSetColorScheme(d, scm[SchemeNorm]);
+		textWidth = s->statusWidth; /* includes 2px right padding */
+		xfttext(d, s->width - textWidth, 0, textWidth, barHeight, 0, s->status, 0);
+	}
+
+	x = 0;
+	for (t = 0; t < LENGTH(tags); t++) {
+		w = xftwidth(d, tags[t]) + leftRightPad;
+		drawSetColorScheme(d, scm[s->selectedTags & 1 << t ? SchemeSel : SchemeNorm]);
+		xfttext(d, x, 0, w, barHeight, leftRightPad / 2, tags[t], s->urgentTags & 1 << t);
+		if (s->occupiedTags & 1 << t)
+			drw_rect(d, x + boxs, boxs, boxw, boxw, s->focusedTags & 1 << t, s->urgentTags & 1 << t);
+		x += w;
+	}
+	w = xftwidth(d, s->layoutSymbol) + leftRightPad;
+	drawSetColorScheme(d, scm[SchemeNorm]);
+	x = xfttext(d, x, 0, w, barHeight, leftRightPad / 2, s->layoutSymbol, 0);
+
+	if ((w = s->width - textWidth - x) > barHeight) {
+		if (s->nTitles > 0) {
+			for (i = 0, textWidth = 0; i < s->nTitles; i++)
+				if (s->titles[i].isSelected)
+					textWidth = xftwidth(d, s->titles[i].name) + 2 * leftRightPad;
+			mw = (textWidth >= w || s->nTitles == 1) ? 0 : (w - textWidth) / (s->nTitles - 1);
+
+			for (i = 0, k = 0; i < s->nTitles; i++) {
+				if (s->titles[i].isSelected)
+					continue;
+				textWidth = xftwidth(d, s->titles[i].name) + leftRightPad;
+				if (textWidth < mw)
+					ew += (mw - textWidth);
+				else
+					k++;
+			}
+			if (k > 0)
+				mw += ew / k;
+
+			for (i = 0; i < s->nTitles; i++) {
+				title = &s->titles[i];
+				textWidth = MIN(title->isSelected ? w : mw,
+				                (int)xftwidth(d, title->name) + leftRightPad);
+				drawSetColorScheme(d, scm[title->isSelected ? SchemeSel : SchemeNorm]);
+				if (textWidth > 0) /* trap special handling of 0 in drw_text */
+					xfttext(d, x, 0, textWidth, barHeight, leftRightPad / 2, title->name, 0);
+				if (title->isFloating)
+					drw_rect(d, x + boxs, boxs, boxw, boxw, title->isFixed, 0);
+				x += textWidth;
+				w -= textWidth;
+			}
 		}
-	return r;
+		drawSetColorScheme(d, scm[SchemeNorm]);
+		drw_rect(d, x, 0, w, barHeight, 1, 1);
+	}
+	drw_map(d, s->window, 0, 0, s->width, barHeight);
 }
 
 void
@@ -1373,10 +2992,10 @@ resizeclient(Client *c, int x, int y, int w, int h)
 {
 	XWindowChanges wc;
 
-	c->oldx = c->x; c->x = wc.x = x;
-	c->oldy = c->y; c->y = wc.y = y;
-	c->oldw = c->w; c->w = wc.width = w;
-	c->oldh = c->h; c->h = wc.height = h;
+	c->cold.oldx = c->x; c->x = wc.x = x;
+	c->cold.oldy = c->y; c->y = wc.y = y;
+	c->cold.oldw = c->w; c->w = wc.width = w;
+	c->cold.oldh = c->h; c->h = wc.height = h;
 	wc.border_width = c->borderWidth;
 	if (((nexttiled(c->monitor->clients) == c && !nexttiled(c->next))
 	    || &monocle == c->monitor->layouts[c->monitor->selectedLayout]->arrange)
@@ -1389,63 +3008,42 @@ resizeclient(Client *c, int x, int y, int w, int h)
 	XConfigureWindow(display, c->window, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
 	configure(c);
 	XSync(display, False);
+	if (c->isFloating) /* tiled geometry is the layout's business */
+		journalclient(c, 0);
 }
 
+/* Start resizing the selected client, motionNotify() and buttonRelease() do the rest */
 void
 resizemouse(const Argument *arg)
 {
-	int ocx, ocy, nw, nh;
 	Client *c;
-	Monitor *m;
-	XEvent ev;
-	Time lasttime = 0;
 
-	if (!(c = selectedMonitor->selectedClient))
+	if (!(c = selectedMonitor->selectedClient) || drag.type != DragNone)
 		return;
 	if (c->isFullscreen) /* no support resizing fullscreen windows by mouse */
 		return;
 	restack(selectedMonitor);
-	ocx = c->x;
-	ocy = c->y;
 	if (XGrabPointer(display, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
                      None, cursor[CurResize]->cursor, CurrentTime) != GrabSuccess)
 		return;
 	XWarpPointer(display, None, c->window, 0, 0, 0, 0, c->w + c->borderWidth - 1, c->h + c->borderWidth - 1);
-	do {
-		XMaskEvent(display, MOUSEMASK | ExposureMask | SubstructureRedirectMask, &ev);
-		switch(ev.type) {
-		case ConfigureRequest:
-		case Expose:
-		case MapRequest:
-			handler[ev.type](&ev);
-			break;
-		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
-				continue;
-			lasttime = ev.xmotion.time;
-
-			nw = MAX(ev.xmotion.x - ocx - 2 * c->borderWidth + 1, 1);
-			nh = MAX(ev.xmotion.y - ocy - 2 * c->borderWidth + 1, 1);
-			if (c->monitor->windowX + nw >= selectedMonitor->windowX && c->monitor->windowX + nw <= selectedMonitor->windowX + selectedMonitor->windowWidth
-                && c->monitor->windowY + nh >= selectedMonitor->windowY && c->monitor->windowY + nh <= selectedMonitor->windowY + selectedMonitor->windowHeight)
-			{
-				if (!c->isFloating && selectedMonitor->layouts[selectedMonitor->selectedLayout]->arrange
-                    && (abs(nw - c->w) > snap || abs(nh - c->h) > snap))
-					togglefloating(NULL);
-			}
-			if (!selectedMonitor->layouts[selectedMonitor->selectedLayout]->arrange || c->isFloating)
-				resize(c, c->x, c->y, nw, nh, 1);
-			break;
-		}
-	} while (ev.type != ButtonRelease);
-	XWarpPointer(display, None, c->window, 0, 0, 0, 0, c->w + c->borderWidth - 1, c->h + c->borderWidth - 1);
-	XUngrabPointer(display, CurrentTime);
-	while (XCheckMaskEvent(display, EnterWindowMask, &ev));
-	if ((m = rectangleToMonitor(c->x, c->y, c->w, c->h)) != selectedMonitor) {
-		sendmon(c, m);
-        selectedMonitor = m;
-		focus(NULL);
+	pointerKnown = 0;
+	drag = (Drag){ .type = DragResize, .client = c, .originX = c->x, .originY = c->y, .started = now() };
+	syncinit(c);
+}
+
+/* Map rule monitor numbers to monitors, once per change of the monitor list */
+void
+resolverules(void)
+{
+	size_t i;
+	Monitor *m;
+
+	for (i = 0; i < nrules; i++) {
+		for (m = monitors; m && m->num != activeRules[i].monitor; m = m->next);
+		ruleSet.monitor[i] = m;
 	}
+	ruleSet.dirty = 0;
 }
 
 void
@@ -1473,13 +3071,92 @@ restack(Monitor *m)
 	while (XCheckMaskEvent(display, EnterWindowMask, &ev));
 }
 
+/* Exec a new dwm that takes over the session, see reexec() */
+void
+restart(const Argument *arg)
+{
+	restarting = 1;
+	running = 0;
+}
+
+/* Put a window found by scan() back where the journal last saw it */
+void
+restoreclient(Client *c)
+{
+	JournalRecord *r, key = { .window = c->window };
+	Monitor *m;
+
+	if (!(r = bsearch(&key, journalReplay, nJournalReplay, sizeof(JournalRecord), comparewindowrecord)))
+		return;
+	for (m = monitors; m && m->num != r->monitor; m = m->next);
+	if (m)
+		c->monitor = m;
+	if (r->tags & TAGMASK)
+		c->tags = r->tags & TAGMASK;
+	if ((c->isFloating = r->flags & JOURNAL_FLOATING ? 1 : 0)) {
+		c->x = r->x;
+		c->y = r->y;
+		c->w = r->w;
+		c->h = r->h;
+	}
+}
+
+/* Count a rule's field as matched; a rule matches once all its fields have */
+void
+rulehit(size_t id, void *arg)
+{
+	unsigned char field = *(unsigned char *)arg;
+
+	if (ruleSet.seen[id] & field)
+		return;
+	if ((ruleSet.seen[id] |= field) == ruleSet.need[id])
+		ruleSet.matched[ruleSet.nmatched++] = id;
+}
+
 void run(void) {
 	XEvent event;
+	struct epoll_event ready[LENGTH(sources)];
+	Source *source;
+	int i, n;
+	long long due;
+
 	/* Main event loop */
 	XSync(display, False);
-	while (running && !XNextEvent(display, &event)) { // Loop through the X event queue
-        if (handler[event.type]) { // If a handler exists for the event type
+	while (running) {
+		/* Xlib reads ahead while handlers talk to the server, so the queue is
+		 * drained with XPending before sleeping, readable or not. Everything
+		 * else is a Source: without pending work epoll_wait() never times out.
+		 * A drag position is applied once its frame is due and nothing else is queued */
+		if (!XPending(display)) {
+			if (journalCompactDue)
+				compactjournal();
+			if (drag.type != DragNone && drag.pending) {
+				if ((due = dragdue()) <= now()) {
+					dragupdate();
+					continue;
+				}
+				dragtimer(due);
+			}
+			if ((n = epoll_wait(epollFd, ready, LENGTH(ready), -1)) < 0 && errno != EINTR)
+				die("epoll_wait:");
+			for (i = 0; i < n; i++)
+				if ((source = ready[i].data.ptr)->ready)
+					source->ready();
+			continue;
+		}
+		if (XNextEvent(display, &event)) // Loop through the X event queue
+			break;
+        if (event.type < LASTEvent && handler[event.type]) { // If a handler exists for the event type
             handler[event.type](&event); // Call the event handler
+        } else if (haveSync && event.type == syncEventBase + XSyncAlarmNotify) {
+            syncalarm(&event);
+        } else if (haveXkb && event.type == xkbEventBase) {
+            xkbnotify(&event);
+#ifdef XRANDR
+        } else if (haveRandr && (event.type == randrEventBase + RRScreenChangeNotify
+                                 || event.type == randrEventBase + RRNotify)) {
+            randrnotify(&event);
+#endif /* XRANDR */
         }
     }
 }
@@ -1490,7 +3167,9 @@ void scan(void) {
 	XWindowAttributes windowAttributes;
 
     /* Get the children of the root window (i.e. all Windows), and continue if they exist */
+	journalReplay = journal_replay(&nJournalReplay); /* windows of a session that crashed */
 	if (XQueryTree(display, root, &rootReturn, &unused, &children, &numberOfChildren)) {
+		adoptstate(children, numberOfChildren);
 		for (i = 0; i < numberOfChildren; i++) {
             /* The override_redirect member is set to indicate whether this window
              * overrides structure control facilities and can be True or False.
@@ -1498,7 +3177,7 @@ void scan(void) {
              * XGetTransientForHint returns non-zero on success,
              * which happens if the WM_TRANSIENT_FOR property is set for the passed window.
              * Usually, this is the case only for transient windows, such as a dialog */
-			if (!XGetWindowAttributes(display, children[i], &windowAttributes)
+			if (!children[i] || !XGetWindowAttributes(display, children[i], &windowAttributes)
                 || windowAttributes.override_redirect || XGetTransientForHint(display, children[i], &rootReturn)) {
                 continue;
             }
@@ -1507,7 +3186,7 @@ void scan(void) {
             }
 		}
 		for (i = 0; i < numberOfChildren; i++) { /* now the transients */
-			if (!XGetWindowAttributes(display, children[i], &windowAttributes))
+			if (!children[i] || !XGetWindowAttributes(display, children[i], &windowAttributes))
 				continue;
 			if (XGetTransientForHint(display, children[i], &rootReturn)
 			&& (windowAttributes.map_state == IsViewable || getState(children[i]) == IconicState))
@@ -1516,6 +3195,11 @@ void scan(void) {
 		if (children)
 			XFree(children);
 	}
+	/* start the journal over from what is managed now */
+	free(journalReplay);
+	journalReplay = NULL;
+	nJournalReplay = 0;
+	journalCompactDue = 1;
 }
 
 void
@@ -1530,6 +3214,7 @@ sendmon(Client *c, Monitor *m)
 	c->tags = m->tagSet[m->selectedTags]; /* assign tags of target monitor */
 	attachBelow(c);
     attachStack(c);
+	journalclient(c, 0);
 	focus(NULL);
 	arrange(NULL);
 }
@@ -1543,6 +3228,18 @@ setclientstate(Client *c, long state)
                     PropModeReplace, (unsigned char *)data, 2);
 }
 
+void
+setconfig(Config *cf)
+{
+	config = cf;
+	activeRules = cf->rules;
+	nrules = cf->nrules;
+	activeKeys = cf->keys;
+	nkeys = cf->nkeys;
+	activeButtons = cf->buttons;
+	nbuttons = cf->nbuttons;
+}
+
 int
 sendevent(Client *c, Atom proto)
 {
@@ -1586,7 +3283,7 @@ setfullscreen(Client *c, int fullscreen)
                         PropModeReplace, (unsigned char*)&netAtom[NetWMFullscreen], 1);
 		c->isFullscreen = 1;
 		c->oldState = c->isFloating;
-		c->oldBorderWidth = c->borderWidth;
+		c->cold.oldBorderWidth = c->borderWidth;
 		c->borderWidth = 0;
 		c->isFloating = 1;
 		resizeclient(c, c->monitor->monitorX, c->monitor->monitorY, c->monitor->monitorWidth, c->monitor->monitorHeight);
@@ -1596,11 +3293,11 @@ setfullscreen(Client *c, int fullscreen)
                         PropModeReplace, (unsigned char*)0, 0);
 		c->isFullscreen = 0;
 		c->isFloating = c->oldState;
-		c->borderWidth = c->oldBorderWidth;
-		c->x = c->oldx;
-		c->y = c->oldy;
-		c->w = c->oldw;
-		c->h = c->oldh;
+		c->borderWidth = c->cold.oldBorderWidth;
+		c->x = c->cold.oldx;
+		c->y = c->cold.oldy;
+		c->w = c->cold.oldw;
+		c->h = c->cold.oldh;
 		resizeclient(c, c->x, c->y, c->w, c->h);
 		arrange(c->monitor);
 	}
@@ -1620,7 +3317,7 @@ setlayout(const Argument *arg)
         drawBar(selectedMonitor);
 }
 
-/* argument > 1.0 will set masterFactor absolutely */
+/* argument > 1.0 will set masterFactor absolutely, relative changes are clamped to [0.05..0.95] */
 void
 setmfact(const Argument *arg)
 {
@@ -1628,19 +3325,26 @@ setmfact(const Argument *arg)
 
 	if (!arg || !selectedMonitor->layouts[selectedMonitor->selectedLayout]->arrange)
 		return;
-	f = arg->f < 1.0 ? arg->f + selectedMonitor->masterFactor : arg->f - 1.0;
-	if (f < 0.05 || f > 0.95)
+	if (arg->f < 1.0)
+		f = MAX(0.05f, MIN(0.95f, arg->f + selectedMonitor->masterFactor));
+	else if ((f = arg->f - 1.0) < 0.05 || f > 0.95)
+		return;
+	if (f == selectedMonitor->masterFactor)
 		return;
     selectedMonitor->masterFactor = f;
 	arrange(selectedMonitor);
 }
 
 void setup(void) {
-	int i;
+	int i, syncMajor, syncMinor, xkbMajor, xkbMinor;
+	char *path;
+#ifdef XRANDR
+	int randrErrorBase, randrMajor, randrMinor;
+#endif /* XRANDR */
 	XSetWindowAttributes windowAttributes;
-	Atom utf8String;
 
-	sigchld(0); // Clean up any zombies immediately
+	pool_init(&clientpool, sizeof(Client), 64);
+	pool_init(&monitorpool, sizeof(Monitor), 4);
 
 	/* Initialize screen */
 	screen = DefaultScreen(display);
@@ -1652,7 +3356,33 @@ void setup(void) {
 		die("No fonts could be loaded.");
     leftRightPad = draw->fonts->height;
     barHeight = draw->fonts->height + 2;
+#ifdef XRANDR
+	/* RandR 1.5 reports monitors directly and notifies us of every change */
+	if (XRRQueryExtension(display, &randrEventBase, &randrErrorBase)
+	&& XRRQueryVersion(display, &randrMajor, &randrMinor)
+	&& (randrMajor > 1 || (randrMajor == 1 && randrMinor >= 5))) {
+		haveRandr = 1;
+		XRRSelectInput(display, root, RRScreenChangeNotifyMask | RROutputChangeNotifyMask
+		               | RRCrtcChangeNotifyMask);
+	}
+#endif /* XRANDR */
     updateGeometry();
+	if (configFile[0]) {
+		configPath = expandpath(configFile);
+		if ((config = loadconfig(configPath)))
+			setconfig(config);
+		watchconfig();
+	}
+	setupsignals(); // before the bar workers, so that they inherit the mask
+	compilerules();
+	if (journalFile[0]) {
+		path = expandpath(journalFile);
+		if (journal_open(path, 4096) < 0)
+			fprintf(stderr, "dwm: cannot open journal %s\n", path);
+		else
+			claimjournal();
+		free(path);
+	}
 	/* init atoms */
 	utf8String = XInternAtom(display, "UTF8_STRING", False);
     /* List of protocols the client is willing to participate in (with the window manager */
@@ -1669,6 +3399,11 @@ void setup(void) {
     netAtom[NetWMWindowType] = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
     netAtom[NetWMWindowTypeDialog] = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DIALOG", False);
     netAtom[NetClientList] = XInternAtom(display, "_NET_CLIENT_LIST", False);
+    netAtom[NetWMSyncRequest] = XInternAtom(display, "_NET_WM_SYNC_REQUEST", False);
+    netAtom[NetWMSyncRequestCounter] = XInternAtom(display, "_NET_WM_SYNC_REQUEST_COUNTER", False);
+	/* init extensions */
+	haveSync = XSyncQueryExtension(display, &syncEventBase, &syncErrorBase)
+	           && XSyncInitialize(display, &syncMajor, &syncMinor);
 	/* init cursors */
 	cursor[CurNormal] = drw_cur_create(draw, XC_left_ptr);
 	cursor[CurResize] = drw_cur_create(draw, XC_sizing);
@@ -1678,6 +3413,31 @@ void setup(void) {
 	for (i = 0; i < LENGTH(colors); i++)
 		scheme[i] = drw_scm_create(draw, colors[i], 3);
 	/* init bars */
+	if (barThreads)
+		startbarworkers();
+	for (i = 0; i < LENGTH(tags); i++)
+		tagsWidth += TEXTW(tags[i]);
+	statusWidth = TEXTW(statusText) - leftRightPad + 2;
+	if (titleUpdateInterval > 0)
+		titleTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (builtinStatus) {
+		statusfd = status_init(statusBlocks, LENGTH(statusBlocks), statusSeparator);
+		if (statusfd >= 0 && statusFifo[0]
+		&& (statusFifoFd = status_openfifo(statusFifoPath = expandpath(statusFifo))) < 0)
+			fprintf(stderr, "dwm: cannot open status FIFO %s\n", statusFifoPath);
+	}
+	/* everything run() waits on */
+	if ((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		die("epoll_create1:");
+	if ((dragTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+		die("timerfd_create:");
+	addsource(ConnectionNumber(display), NULL); // Drained by run() with XPending
+	addsource(statusfd, updateblocks);
+	addsource(statusFifoFd, updateblocks);
+	addsource(titleTimerFd, flushtitles);
+	addsource(configWatchFd, configchanged);
+	addsource(signalFd, signalnotify);
+	addsource(dragTimerFd, dragexpired);
 	updatebars();
 	updatestatus();
 	/* supporting window for NetWMCheck */
@@ -1699,7 +3459,15 @@ void setup(void) {
                                   | LeaveWindowMask | StructureNotifyMask | PropertyChangeMask;
 	XChangeWindowAttributes(display, root, CWEventMask | CWCursor, &windowAttributes);
 	XSelectInput(display, root, windowAttributes.event_mask);
+	updatenumlockmask();
 	grabkeys();
+	/* held keys send presses only, so repeats queue up back to back */
+	XkbSetDetectableAutoRepeat(display, True, NULL);
+	/* a new keyboard comes as an XKB event once we ask for them, not as MappingNotify */
+	xkbMajor = XkbMajorVersion;
+	xkbMinor = XkbMinorVersion;
+	if ((haveXkb = XkbQueryExtension(display, NULL, &xkbEventBase, NULL, &xkbMajor, &xkbMinor)))
+		XkbSelectEvents(display, XkbUseCoreKbd, XkbNewKeyboardNotifyMask, XkbNewKeyboardNotifyMask);
 	focus(NULL);
 }
 
@@ -1735,44 +3503,203 @@ showhide(Client *c)
 	}
 }
 
-void sigchld(int unused) {
-	if (signal(SIGCHLD, sigchld) == SIG_ERR) // Set the handler for the signal SIGCHLD to sigchld, returning the old handler, or SIG_ERR on error, whatever this means...
-		die("Can't install SIGCHLD handler:"); // Print error and exit
-	while (0 < waitpid(-1, NULL, WNOHANG)); // Wait for any process to die (?)
+/* Take SIGCHLD, SIGHUP and SIGUSR1 through signalFd instead of handlers, so
+ * they are dealt with in the main loop like any other event. SIGHUP is left
+ * alone unless there is a config file to reload. */
+void
+setupsignals(void)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGUSR1);
+	if (configPath)
+		sigaddset(&mask, SIGHUP);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0
+	|| (signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+		die("signalfd:");
+	reapchildren(); // Clean up any zombies immediately
+}
+
+void
+signalnotify(void)
+{
+	struct signalfd_siginfo info;
+	int reap = 0, reload = 0;
+
+	/* signals of a kind coalesce while pending, so SIGCHLD means one or more children */
+	while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+		if (info.ssi_signo == SIGCHLD)
+			reap = 1;
+		else if (info.ssi_signo == SIGHUP)
+			reload = 1;
+		else if (info.ssi_signo == SIGUSR1)
+			printstats();
+	}
+	if (reap)
+		reapchildren();
+	if (reload)
+		reloadconfig();
 }
 
+/* Start a command through spawncmd(), which neither copies dwm's address
+ * space nor lets the child inherit its descriptors or signal handling */
 void spawn(const Argument *argument) {
+	char **argv = (char **)argument->v;
+	Child *child;
+	pid_t pid;
+	int err;
+
     /* If the command is the dmenu command, set the dmenu monitor to pass it as an argument */
     if (argument->v == dmenuCommand) {
         dmenuMonitor[0] = '0' + selectedMonitor->num;
     }
-    /* Create a new process by duplicating the calling process (dwm)
-     * The new process is referred to as the child process
-     * The calling process is referred to as the parent process
-     * The child process will have the PID of the old calling process
-     * The PID of the parent process changes
-     * It only returns 0 for the child process, the parent process returns its new PID,
-     * so only the child process enters the conditional */
-	if (fork() == 0) {
-		if (display)
-			close(ConnectionNumber(display));
-        /* Create a new session with the calling process as its leader.
-         * The process group IDs of the session and the calling process
-         * are set to the process ID of the calling process, which is returned.
-         * This detaches the child from the parent, as I understand. */
-		setsid();
-        /* Replace the calling process with a new one, called like (command, arguments)
-         * The first element of the arguments is the command itself
-         * The arguments must be NULL terminated
-         * argument is converted to a pointer to a pointer because it is an array of strings (array of arrays)
-         * The "v" in execvp stands for "vector", because we pass the arguments as a vector
-         * The "p" in execvp stands for "path", because we use the system path in the call */
-		execvp(((char **)argument->v)[0], (char **)argument->v);
-        /* These lines will only be reached if the exec call fails, since the process won't be replaced */
-		fprintf(stderr, "dwm: execvp %s", ((char **)argument->v)[0]);
-		perror(" failed");
-		exit(EXIT_SUCCESS);
+	if ((err = spawncmd(argv, &pid))) {
+		fprintf(stderr, "dwm: cannot spawn %s: %s\n", argv[0], strerror(err));
+	} else {
+		/* SIGCHLD stays pending until the main loop, so the child is reaped after this */
+		child = &spawned[nSpawned++ % LENGTH(spawned)];
+		*child = (Child){ .pid = pid, .started = now() };
+		snprintf(child->name, sizeof(child->name), "%s", argv[0]);
+	}
+}
+
+/* Give each renderer its own connection, fonts and colors so bars can be
+ * drawn without touching the window manager's connection */
+void
+startbarworkers(void)
+{
+	int i, j;
+	BarWorker *w;
+
+	barWorkers = ecalloc(barThreads, sizeof(BarWorker));
+	for (i = 0; i < (int)barThreads; i++) {
+		w = &barWorkers[i];
+		if (!(w->display = XOpenDisplay(NULL))) {
+			fputs("dwm: cannot open display for bar renderer\n", stderr);
+			break;
+		}
+		w->draw = drawCreate(w->display, screen, RootWindow(w->display, screen), screenWidth, barHeight);
+		if (!drawFontsetCreate(w->draw, fonts, LENGTH(fonts))) {
+			drw_free(w->draw);
+			XCloseDisplay(w->display);
+			break;
+		}
+		w->scheme = ecalloc(LENGTH(colors), sizeof(Color *));
+		for (j = 0; j < LENGTH(colors); j++)
+			w->scheme[j] = drw_scm_create(w->draw, colors[j], 3);
+		pthread_mutex_init(&w->lock, NULL);
+		pthread_cond_init(&w->wake, NULL);
+		if (pthread_create(&w->thread, NULL, barworker, w)) {
+			freebarworker(w);
+			break;
+		}
+		nBarWorkers++;
+	}
+}
+
+/* Index of c among the clients saved by reexec(), STATE_NONE for NULL */
+uint32_t
+stateindex(Client **sorted, size_t n, Client *c)
+{
+	Client **p;
+
+	if (!c || !(p = bsearch(&c, sorted, n, sizeof(Client *), compareclient)))
+		return STATE_NONE;
+	return p - sorted;
+}
+
+void
+stopbarworkers(void)
+{
+	int i;
+	BarWorker *w;
+
+	for (i = 0; i < nBarWorkers; i++) {
+		w = &barWorkers[i];
+		pthread_mutex_lock(&w->lock);
+		w->stop = 1;
+		pthread_cond_signal(&w->wake);
+		pthread_mutex_unlock(&w->lock);
+		pthread_join(w->thread, NULL);
+		freebarworker(w);
+	}
+	free(barWorkers);
+	barWorkers = NULL;
+	nBarWorkers = 0;
+}
+
+/* The resized client has drawn the size of its last sync request */
+void
+syncalarm(XEvent *e)
+{
+	XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+
+	if (drag.syncAlarm && ev->alarm == drag.syncAlarm)
+		drag.syncWaiting = 0;
+}
+
+/* Look up the _NET_WM_SYNC_REQUEST counter of a client about to be resized */
+void
+syncinit(Client *c)
+{
+	int n, format, supported = 0;
+	unsigned long nitems, after;
+	unsigned char *p = NULL;
+	Atom *protocols, type;
+
+	drag.syncCounter = None;
+	if (!haveSync || !XGetWMProtocols(display, c->window, &protocols, &n))
+		return;
+	while (!supported && n--)
+		supported = protocols[n] == netAtom[NetWMSyncRequest];
+	XFree(protocols);
+	if (supported && XGetWindowProperty(display, c->window, netAtom[NetWMSyncRequestCounter], 0L, 1L, False,
+	                                    XA_CARDINAL, &type, &format, &nitems, &after, &p) == Success && p) {
+		if (format == 32 && nitems == 1)
+			drag.syncCounter = *(long *)p;
+		XFree(p);
 	}
+	if (drag.syncCounter && !XSyncQueryCounter(display, drag.syncCounter, &drag.syncValue))
+		drag.syncCounter = None;
+}
+
+/* Ask the resized client to report when it has drawn the next size */
+void
+syncrequest(Client *c)
+{
+	int overflow;
+	XEvent ev;
+	XSyncValue one;
+	XSyncAlarmAttributes aa;
+
+	XSyncIntToValue(&one, 1);
+	XSyncValueAdd(&drag.syncValue, drag.syncValue, one, &overflow);
+	ev.type = ClientMessage;
+	ev.xclient.window = c->window;
+	ev.xclient.message_type = wmAtom[WMProtocols];
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = netAtom[NetWMSyncRequest];
+	ev.xclient.data.l[1] = CurrentTime;
+	ev.xclient.data.l[2] = XSyncValueLow32(drag.syncValue);
+	ev.xclient.data.l[3] = XSyncValueHigh32(drag.syncValue);
+	ev.xclient.data.l[4] = 0;
+	XSendEvent(display, c->window, False, NoEventMask, &ev);
+
+	aa.trigger.counter = drag.syncCounter;
+	aa.trigger.value_type = XSyncAbsolute;
+	aa.trigger.wait_value = drag.syncValue;
+	aa.trigger.test_type = XSyncPositiveComparison;
+	XSyncIntToValue(&aa.delta, 0);
+	aa.events = True;
+	if (drag.syncAlarm)
+		XSyncChangeAlarm(display, drag.syncAlarm, XSyncCAValue, &aa);
+	else
+		drag.syncAlarm = XSyncCreateAlarm(display, XSyncCACounter | XSyncCAValueType | XSyncCAValue
+		                                  | XSyncCATestType | XSyncCADelta | XSyncCAEvents, &aa);
+	drag.syncWaiting = 1;
+	drag.syncRequested = now();
 }
 
 void
@@ -1780,6 +3707,7 @@ tag(const Argument *arg)
 {
 	if (selectedMonitor->selectedClient && arg->ui & TAGMASK) {
         selectedMonitor->selectedClient->tags = arg->ui & TAGMASK;
+		journalclient(selectedMonitor->selectedClient, 0);
 		focus(NULL);
 		arrange(selectedMonitor);
 	}
@@ -1793,6 +3721,44 @@ tagmon(const Argument *arg)
 	sendmon(selectedMonitor->selectedClient, dirtomon(arg->i));
 }
 
+/* Text width on the main connection */
+unsigned int
+textwidth(const char *text)
+{
+	return xftwidth(draw, text);
+}
+
+/* A client renamed itself: fetch the title right away unless it was fetched
+ * less than titleUpdateInterval ago, then leave it to flushtitles() */
+void
+titlenotify(Client *c)
+{
+	long long t = now();
+
+	if (c->titleDirty)
+		return;
+	if (titleTimerFd < 0 || t - c->cold.titleFetched >= titleUpdateInterval * 1000LL) {
+		c->cold.titleFetched = t;
+		if (updatetitle(c) && ISVISIBLE(c)) /* every visible title is on the bar */
+			drawBar(c->monitor);
+		return;
+	}
+	c->titleDirty = 1;
+	titletimer(c->cold.titleFetched + titleUpdateInterval * 1000LL);
+}
+
+/* Make sure the title timer fires by due (a now() timestamp) */
+void
+titletimer(long long due)
+{
+	struct itimerspec its = { { 0, 0 }, { due / 1000000, due % 1000000 * 1000 } };
+
+	if (titlesDue && titlesDue <= due)
+		return;
+	titlesDue = due;
+	timerfd_settime(titleTimerFd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
 void
 tile(Monitor *m)
 {
@@ -1839,6 +3805,7 @@ togglefloating(const Argument *arg)
 	if (selectedMonitor->selectedClient->isFloating)
 		resize(selectedMonitor->selectedClient, selectedMonitor->selectedClient->x, selectedMonitor->selectedClient->y,
                selectedMonitor->selectedClient->w, selectedMonitor->selectedClient->h, 0);
+	journalclient(selectedMonitor->selectedClient, 0);
 	arrange(selectedMonitor);
 }
 
@@ -1852,6 +3819,7 @@ toggletag(const Argument *arg)
 	newtags = selectedMonitor->selectedClient->tags ^ (arg->ui & TAGMASK);
 	if (newtags) {
         selectedMonitor->selectedClient->tags = newtags;
+		journalclient(selectedMonitor->selectedClient, 0);
 		focus(NULL);
 		arrange(selectedMonitor);
 	}
@@ -1888,10 +3856,13 @@ unmanage(Client *c, int destroyed)
 	Monitor *m = c->monitor;
 	XWindowChanges wc;
 
+	if (drag.client == c)
+		dragend(0);
+	journalclient(c, 1);
 	detach(c);
     detachStack(c);
 	if (!destroyed) {
-		wc.border_width = c->oldBorderWidth;
+		wc.border_width = c->cold.oldBorderWidth;
 		XGrabServer(display); /* avoid race conditions */
 		XSetErrorHandler(xerrordummy);
 		XConfigureWindow(display, c->window, CWBorderWidth, &wc); /* restore border */
@@ -1901,7 +3872,7 @@ unmanage(Client *c, int destroyed)
 		XSetErrorHandler(xerror);
 		XUngrabServer(display);
 	}
-	free(c);
+	pool_free(&clientpool, c);
 	focus(NULL);
 	updateclientlist();
 	arrange(m);
@@ -1946,6 +3917,7 @@ updatebars(void)
 void
 updatebarpos(Monitor *m)
 {
+	monitorMap.dirty = 1;
 	m->windowY = m->monitorY;
 	m->windowHeight = m->monitorHeight;
 	if (m->showBar) {
@@ -1956,6 +3928,18 @@ updatebarpos(Monitor *m)
 		m->by = -barHeight;
 }
 
+/* Pick up the status blocks that are due and those written to the FIFO */
+void
+updateblocks(void)
+{
+	int changed = status_tick();
+
+	if (status_readfifo())
+		changed = 1;
+	if (changed)
+		updatestatus();
+}
+
 void
 updateclientlist()
 {
@@ -1973,6 +3957,11 @@ updateclientlist()
 int updateGeometry(void) {
 	int dirty = 0;
 
+#ifdef XRANDR
+	if (haveRandr) {
+		dirty = updaterandr();
+	} else
+#endif /* XRANDR */
 #ifdef XINERAMA
 	if (XineramaIsActive(display)) {
 		int i, j, n, nn;
@@ -2004,6 +3993,7 @@ int updateGeometry(void) {
 				{
 					dirty = 1;
 					m->num = i;
+					ruleSet.dirty = 1;
                     m->monitorX = m->windowX = unique[i].x_org;
                     m->monitorY = m->windowY = unique[i].y_org;
                     m->monitorWidth = m->windowWidth = unique[i].width;
@@ -2043,26 +4033,220 @@ int updateGeometry(void) {
 	if (dirty) {
         selectedMonitor = monitors;
         selectedMonitor = windowToMonitor(root);
+		updaterefreshrates();
 	}
 	return dirty;
 }
 
+static int
+compareint(const void *a, const void *b)
+{
+	return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b);
+}
+
+/* Rebuild the grid used by pointToMonitor() from the monitor window areas */
+void
+updatemonitormap(void)
+{
+	int i, j, n, k;
+	Monitor *m;
+
+	for (n = 0, m = monitors; m; m = m->next, n++);
+	free(monitorMap.xs);
+	free(monitorMap.ys);
+	free(monitorMap.cells);
+	monitorMap.xs = ecalloc(2 * n + 1, sizeof(int));
+	monitorMap.ys = ecalloc(2 * n + 1, sizeof(int));
+	for (i = 0, m = monitors; m; m = m->next) {
+		monitorMap.xs[i] = m->windowX;
+		monitorMap.ys[i++] = m->windowY;
+		monitorMap.xs[i] = m->windowX + m->windowWidth;
+		monitorMap.ys[i++] = m->windowY + m->windowHeight;
+	}
+	qsort(monitorMap.xs, 2 * n, sizeof(int), compareint);
+	qsort(monitorMap.ys, 2 * n, sizeof(int), compareint);
+	for (i = k = 0; i < 2 * n; i++)
+		if (!k || monitorMap.xs[i] != monitorMap.xs[k - 1])
+			monitorMap.xs[k++] = monitorMap.xs[i];
+	monitorMap.nx = k;
+	for (i = k = 0; i < 2 * n; i++)
+		if (!k || monitorMap.ys[i] != monitorMap.ys[k - 1])
+			monitorMap.ys[k++] = monitorMap.ys[i];
+	monitorMap.ny = k;
+	monitorMap.cells = ecalloc(MAX((monitorMap.nx - 1) * (monitorMap.ny - 1), 1), sizeof(Monitor *));
+	for (j = 0; j < monitorMap.ny - 1; j++)
+		for (i = 0; i < monitorMap.nx - 1; i++) {
+			for (m = monitors; m; m = m->next)
+				if (monitorMap.xs[i] >= m->windowX && monitorMap.xs[i] < m->windowX + m->windowWidth
+				&& monitorMap.ys[j] >= m->windowY && monitorMap.ys[j] < m->windowY + m->windowHeight)
+					break;
+			monitorMap.cells[j * (monitorMap.nx - 1) + i] = m;
+		}
+	monitorMap.last = NULL;
+	monitorMap.dirty = 0;
+}
+
+/* Regrab everything after the keyboard mapping changed: keysyms may sit on
+ * other keycodes and NumLock may have moved, which all grabs depend on */
+void
+updatekeyboard(void)
+{
+	Client *c;
+	Monitor *m;
+
+	updatenumlockmask();
+	grabkeys();
+	for (m = monitors; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			grabButtons(c, c == selectedMonitor->selectedClient);
+}
+
 void
 updatenumlockmask(void)
 {
 	unsigned int i, j;
+	KeyCode numlock;
 	XModifierKeymap *modmap;
 
 	numlockmask = 0;
 	modmap = XGetModifierMapping(display);
+	numlock = XKeysymToKeycode(display, XK_Num_Lock);
 	for (i = 0; i < 8; i++)
 		for (j = 0; j < modmap->max_keypermod; j++)
-			if (modmap->modifiermap[i * modmap->max_keypermod + j]
-				== XKeysymToKeycode(display, XK_Num_Lock))
+			if (modmap->modifiermap[i * modmap->max_keypermod + j] == numlock)
 				numlockmask = (1 << i);
 	XFreeModifiermap(modmap);
 }
 
+#ifdef XRANDR
+/* Bring the monitor list in line with the RandR monitors, touching only what
+ * changed: new monitors are created, vanished ones hand their clients to the
+ * first remaining monitor and resized ones are rearranged. Monitors that are
+ * not on screen yet (no bar window) are left for the caller to arrange once
+ * updatebars() has made their bars. */
+int
+updaterandr(void)
+{
+	int i, n, dirty = 0, refocus = 0;
+	unsigned char *changed;
+	Client *c;
+	Monitor *m, *next, **order;
+	XRRMonitorInfo *info;
+
+	if (!(info = XRRGetMonitors(display, root, True, &n)))
+		return 0;
+	if (n <= 0) { /* everything is off, keep the layout until an output returns */
+		XRRFreeMonitors(info);
+		return 0;
+	}
+	order = ecalloc(n, sizeof(Monitor *));
+	changed = ecalloc(n, 1);
+	for (i = 0; i < n; i++) {
+		for (m = monitors; m && m->output != info[i].name; m = m->next);
+		if (!m) {
+			m = createMonitor();
+			m->output = info[i].name;
+		}
+		order[i] = m;
+		if (info[i].x != m->monitorX || info[i].y != m->monitorY
+		|| info[i].width != m->monitorWidth || info[i].height != m->monitorHeight) {
+			dirty = changed[i] = 1;
+			m->monitorX = m->windowX = info[i].x;
+			m->monitorY = m->windowY = info[i].y;
+			m->monitorWidth = m->windowWidth = info[i].width;
+			m->monitorHeight = m->windowHeight = info[i].height;
+			updatebarpos(m);
+		}
+	}
+	XRRFreeMonitors(info);
+	for (m = monitors; m; m = next) {
+		next = m->next;
+		for (i = 0; i < n && order[i] != m; i++);
+		if (i < n)
+			continue;
+		dirty = changed[0] = 1;
+		while ((c = m->clients)) {
+			m->clients = c->next;
+			detachStack(c);
+			c->monitor = order[0];
+			attach(c);
+			attachStack(c);
+		}
+		if (m == selectedMonitor) {
+			selectedMonitor = order[0];
+			refocus = 1;
+		}
+		cleanupmon(m);
+	}
+	/* keep the server's order so monitor numbers match other RandR clients */
+	for (i = 0; i < n; i++) {
+		order[i]->num = i;
+		order[i]->next = i + 1 < n ? order[i + 1] : NULL;
+	}
+	monitors = order[0];
+	monitorMap.dirty = 1;
+	ruleSet.dirty = 1;
+	for (i = 0; i < n; i++) {
+		m = order[i];
+		if (!changed[i] || !m->barWindow)
+			continue;
+		XMoveResizeWindow(display, m->barWindow, m->windowX, m->by, m->windowWidth, barHeight);
+		for (c = m->clients; c; c = c->next)
+			if (c->isFullscreen)
+				resizeclient(c, m->monitorX, m->monitorY, m->monitorWidth, m->monitorHeight);
+		arrange(m);
+	}
+	if (refocus)
+		focus(NULL);
+	free(changed);
+	free(order);
+	return dirty;
+}
+#endif /* XRANDR */
+
+/* Take each monitor's refresh rate from the mode of the CRTC showing it */
+void
+updaterefreshrates(void)
+{
+#ifdef XRANDR
+	int i, j, rate, event, error;
+	Monitor *m;
+	XRRScreenResources *res;
+	XRRCrtcInfo *crtc;
+	XRRModeInfo *mode;
+
+	if (!XRRQueryExtension(display, &event, &error)
+	|| !(res = XRRGetScreenResourcesCurrent(display, root)))
+		return;
+	for (m = monitors; m; m = m->next)
+		m->refreshRate = 0;
+	for (i = 0; i < res->ncrtc; i++) {
+		if (!(crtc = XRRGetCrtcInfo(display, res, res->crtcs[i])))
+			continue;
+		for (j = 0, mode = NULL; crtc->mode != None && j < res->nmode; j++)
+			if (res->modes[j].id == crtc->mode)
+				mode = &res->modes[j];
+		if (mode && mode->hTotal && mode->vTotal) {
+			rate = (int)((double)mode->dotClock / ((double)mode->hTotal * mode->vTotal) + 0.5);
+			if (mode->modeFlags & RR_DoubleScan)
+				rate /= 2;
+			if (mode->modeFlags & RR_Interlace)
+				rate *= 2;
+			/* a monitor shown by several CRTCs follows the fastest one */
+			for (m = monitors; m; m = m->next)
+				if (crtc->x >= m->monitorX && crtc->x < m->monitorX + m->monitorWidth
+				&& crtc->y >= m->monitorY && crtc->y < m->monitorY + m->monitorHeight)
+					m->refreshRate = MAX(m->refreshRate, rate);
+		}
+		XRRFreeCrtcInfo(crtc);
+	}
+	XRRFreeScreenResources(res);
+	for (m = monitors; m; m = m->next)
+		if (!m->refreshRate)
+			m->refreshRate = 60;
+#endif /* XRANDR */
+}
+
 void
 updatesizehints(Client *c)
 {
@@ -2073,54 +4257,72 @@ updatesizehints(Client *c)
 		/* size is uninitialized, ensure that size.flags aren't used */
 		size.flags = PSize;
 	if (size.flags & PBaseSize) {
-		c->basew = size.base_width;
-		c->baseh = size.base_height;
+		c->cold.basew = size.base_width;
+		c->cold.baseh = size.base_height;
 	} else if (size.flags & PMinSize) {
-		c->basew = size.min_width;
-		c->baseh = size.min_height;
+		c->cold.basew = size.min_width;
+		c->cold.baseh = size.min_height;
 	} else
-		c->basew = c->baseh = 0;
+		c->cold.basew = c->cold.baseh = 0;
 	if (size.flags & PResizeInc) {
-		c->incw = size.width_inc;
-		c->inch = size.height_inc;
+		c->cold.incw = size.width_inc;
+		c->cold.inch = size.height_inc;
 	} else
-		c->incw = c->inch = 0;
+		c->cold.incw = c->cold.inch = 0;
 	if (size.flags & PMaxSize) {
-		c->maxw = size.max_width;
-		c->maxh = size.max_height;
+		c->cold.maxw = size.max_width;
+		c->cold.maxh = size.max_height;
 	} else
-		c->maxw = c->maxh = 0;
+		c->cold.maxw = c->cold.maxh = 0;
 	if (size.flags & PMinSize) {
-		c->minw = size.min_width;
-		c->minh = size.min_height;
+		c->cold.minw = size.min_width;
+		c->cold.minh = size.min_height;
 	} else if (size.flags & PBaseSize) {
-		c->minw = size.base_width;
-		c->minh = size.base_height;
+		c->cold.minw = size.base_width;
+		c->cold.minh = size.base_height;
 	} else
-		c->minw = c->minh = 0;
+		c->cold.minw = c->cold.minh = 0;
 	if (size.flags & PAspect) {
-		c->mina = (float)size.min_aspect.y / size.min_aspect.x;
-		c->maxa = (float)size.max_aspect.x / size.max_aspect.y;
+		c->cold.mina = (float)size.min_aspect.y / size.min_aspect.x;
+		c->cold.maxa = (float)size.max_aspect.x / size.max_aspect.y;
 	} else
-		c->maxa = c->mina = 0.0;
-	c->isFixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
+		c->cold.maxa = c->cold.mina = 0.0;
+	c->isFixed = (c->cold.maxw && c->cold.maxh && c->cold.maxw == c->cold.minw && c->cold.maxh == c->cold.minh);
 }
 
 void
 updatestatus(void)
 {
-	if (!gettextprop(root, XA_WM_NAME, statusText, sizeof(statusText)))
-		strcpy(statusText, "dwm-"VERSION);
-    drawBar(selectedMonitor);
+	char text[sizeof(statusText)];
+
+	if (statusfd >= 0)
+		strcpy(text, status_text());
+	else if (!gettextprop(root, XA_WM_NAME, text, sizeof(text)))
+		strcpy(text, "dwm-"VERSION);
+	/* status scripts tend to rewrite the same text every tick */
+	if (!strcmp(text, statusText)) {
+		statusStats.unchanged++;
+		return;
+	}
+	statusStats.redrawn++;
+	strcpy(statusText, text);
+	statusWidth = TEXTW(statusText) - leftRightPad + 2;
+	drawstatus();
 }
 
-void
+int
 updatetitle(Client *c)
 {
-	if (!gettextprop(c->window, netAtom[NetWMName], c->name, sizeof c->name))
-		gettextprop(c->window, XA_WM_NAME, c->name, sizeof c->name);
-	if (c->name[0] == '\0') /* hack to mark broken clients */
-		strcpy(c->name, broken);
+	char name[sizeof(c->cold.name)];
+
+	if (!gettextprop(c->window, netAtom[NetWMName], name, sizeof name))
+		gettextprop(c->window, XA_WM_NAME, name, sizeof name);
+	if (name[0] == '\0') /* hack to mark broken clients */
+		strcpy(name, broken);
+	if (!strcmp(name, c->cold.name))
+		return 0;
+	strcpy(c->cold.name, name);
+	return 1;
 }
 
 void
@@ -2166,6 +4368,30 @@ view(const Argument *arg)
 	arrange(selectedMonitor);
 }
 
+/* Watch the directory rather than the file, which editors and dwmrc replace
+ * by renaming a new one over it */
+void
+watchconfig(void)
+{
+	char *dir = ecalloc(strlen(configPath) + 2, 1), *slash;
+
+	strcpy(dir, configPath);
+	slash = strrchr(configPath, '/');
+	configName = slash ? slash + 1 : configPath;
+	if (!(slash = strrchr(dir, '/')))
+		strcpy(dir, ".");
+	else if (slash == dir)
+		dir[1] = '\0'; /* in / itself */
+	else
+		*slash = '\0';
+	if ((configWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0
+	&& inotify_add_watch(configWatchFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		close(configWatchFd);
+		configWatchFd = -1;
+	}
+	free(dir);
+}
+
 Client *windowToClient(Window window) {
 	Client *c;
 	Monitor *m;
@@ -2183,7 +4409,7 @@ Monitor *windowToMonitor(Window window) {
 	Monitor *monitor;
 
     if (window == root && getRootPointer(&x, &y)) {
-        return rectangleToMonitor(x, y, 1, 1);
+        return pointToMonitor(x, y);
     }
     for (monitor = monitors; monitor; monitor = monitor->next) {
         if (window == monitor->barWindow) {
@@ -2202,6 +4428,8 @@ Monitor *windowToMonitor(Window window) {
 int
 xerror(Display *dpy, XErrorEvent *ee)
 {
+	if (dpy != display) /* a bar renderer drew a bar that has just gone */
+		return 0;
 	if (ee->error_code == BadWindow
 	|| (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch)
 	|| (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable)
@@ -2210,7 +4438,9 @@ xerror(Display *dpy, XErrorEvent *ee)
 	|| (ee->request_code == X_ConfigureWindow && ee->error_code == BadMatch)
 	|| (ee->request_code == X_GrabButton && ee->error_code == BadAccess)
 	|| (ee->request_code == X_GrabKey && ee->error_code == BadAccess)
-	|| (ee->request_code == X_CopyArea && ee->error_code == BadDrawable))
+	|| (ee->request_code == X_CopyArea && ee->error_code == BadDrawable)
+	|| (haveSync && (ee->error_code == syncErrorBase + XSyncBadCounter
+	                 || ee->error_code == syncErrorBase + XSyncBadAlarm)))
 		return 0;
 	fprintf(stderr, "dwm: fatal error: request code=%d, error code=%d\n",
 		ee->request_code, ee->error_code);
@@ -2232,6 +4462,44 @@ xerrorstart(Display *dpy, XErrorEvent *ee)
 	return -1;
 }
 
+void
+xkbnotify(XEvent *e)
+{
+	XkbEvent *ev = (XkbEvent *)e;
+
+	if (ev->any.xkb_type == XkbNewKeyboardNotify)
+		updatekeyboard();
+}
+
+/* drw_text() and drw_fontset_getwidth() while bar renderers may be running:
+ * Xft and fontconfig keep process-wide caches, so only these calls are
+ * serialised, the rest of a bar is filled and copied in parallel */
+int
+xfttext(Draw *d, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert)
+{
+	int r;
+
+	if (nBarWorkers)
+		pthread_mutex_lock(&xftLock);
+	r = drw_text(d, x, y, w, h, lpad, text, invert);
+	if (nBarWorkers)
+		pthread_mutex_unlock(&xftLock);
+	return r;
+}
+
+unsigned int
+xftwidth(Draw *d, const char *text)
+{
+	unsigned int w;
+
+	if (nBarWorkers)
+		pthread_mutex_lock(&xftLock);
+	w = drw_fontset_getwidth(d, text);
+	if (nBarWorkers)
+		pthread_mutex_unlock(&xftLock);
+	return w;
+}
+
 void
 zoom(const Argument *arg)
 {
@@ -2252,6 +4520,9 @@ int main(int argc, char *argv[]) { // Entrypoint
     } else if (argc != 1) { // Else if the argument count is not 1 (i.e. is greater than 2)
         die("usage: dwm [-v]"); // Print usage and exit
     }
+    if (barThreads && !XInitThreads()) { // Bar renderers use Xlib from their own threads
+        die("dwm: cannot initialize Xlib threads");
+    }
     if (!setlocale(LC_CTYPE, "") || !XSupportsLocale()) { // Set locale from $LAND environment variable and checks if X can operate using the current locale
         fputs("warning: no locale support\n", stderr); // Print error and exit
     }
@@ -2265,7 +4536,14 @@ int main(int argc, char *argv[]) { // Entrypoint
 		die("pledge");
 #endif /* __OpenBSD__ */
 	scan(); // Check if other programs are running, so that they can be added to DWM when launched
-	run(); // Main program
+	for (;;) {
+		run(); // Main program
+		if (!restarting)
+			break;
+		reexec(argv); // Only returns if the new process could not be started
+		restarting = 0;
+		running = 1;
+	}
 	cleanup();
 	XCloseDisplay(display);
 	return EXIT_SUCCESS;
@@ -0,0 +1,312 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * dwmrc compiles a text file of rules and bindings into the format dwm maps
+ * at startup (see dwmrc.h). Each line is one of
+ *
+ *	rule   <class> <instance> <title> <tags> <isfloating> <monitor>
+ *	key    <modifiers> <keysym> <function> [argument]
+ *	button <click> <modifiers> <button> <function> [argument]
+ *
+ * where - stands for no pattern, modifiers are joined with | (Mod4|Shift)
+ * and an argument is one of i <n>, ui <n>, f <x>, layout <n>, dmenu or
+ * cmd <word>... Words containing blanks are double quoted, # starts a comment.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+
+#include "dwmrc.h"
+#include "util.h"
+
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define MAXWORDS                64
+
+/* in the order of the Click enum in dwm.c */
+static const char *clicks[] = {
+	"TagBar", "LayoutSymbol", "StatusText", "WindowTitle", "ClientWindow", "RootWindow"
+};
+
+static const struct {
+	const char *name;
+	unsigned int mask;
+} modifiers[] = {
+	{ "Shift", ShiftMask }, { "Lock", LockMask }, { "Control", ControlMask }, { "Ctrl", ControlMask },
+	{ "Mod1", Mod1Mask }, { "Mod2", Mod2Mask }, { "Mod3", Mod3Mask }, { "Mod4", Mod4Mask },
+	{ "Mod5", Mod5Mask },
+};
+
+#define FUNCTION(f, types) { #f, types },
+static const struct {
+	const char *name;
+	uint32_t args;
+} functions[] = {
+	RC_FUNCTIONS(FUNCTION)
+};
+#undef FUNCTION
+
+static RcRule *rules;
+static RcKey *keys;
+static RcButton *buttons;
+static char *strings;
+static size_t nrules, nkeys, nbuttons, nstrings;
+static const char *file;
+static int lineno;
+
+/* Make room for element n, doubling the array whenever n is a power of two */
+static void *
+grow(void *p, size_t n, size_t size)
+{
+	if (n & (n - 1))
+		return p;
+	if (!(p = realloc(p, (n ? n * 2 : 1) * size)))
+		die("realloc:");
+	return p;
+}
+
+static void
+error(const char *msg, const char *word)
+{
+	die("dwmrc: %s:%d: %s%s%s", file, lineno, msg, word ? " " : "", word ? word : "");
+}
+
+static uint32_t
+addstring(const char *s)
+{
+	size_t len = strlen(s) + 1;
+	uint32_t offset = nstrings;
+
+	if (!(strings = realloc(strings, nstrings + len)))
+		die("realloc:");
+	memcpy(strings + nstrings, s, len);
+	nstrings += len;
+	return offset;
+}
+
+/* Split a line into words, honouring double quotes and # comments */
+static int
+split(char *s, char **words)
+{
+	int n = 0;
+
+	for (;;) {
+		while (*s == ' ' || *s == '\t' || *s == '\n')
+			s++;
+		if (!*s || *s == '#')
+			return n;
+		if (n == MAXWORDS)
+			error("too many words", NULL);
+		if (*s == '"') {
+			words[n++] = ++s;
+			if (!(s = strchr(s, '"')))
+				error("unterminated quote", NULL);
+		} else {
+			words[n++] = s;
+			s += strcspn(s, " \t\n");
+			if (!*s)
+				return n;
+		}
+		*s++ = '\0';
+	}
+}
+
+/* Numbers are C literals, optionally complemented (~0) or shifted (1<<8) */
+static long
+number(const char *s)
+{
+	char *end;
+	long n;
+	int complement = 0;
+
+	if (*s == '~') {
+		complement = 1;
+		s++;
+	}
+	errno = 0;
+	n = strtol(s, &end, 0);
+	if (end[0] == '<' && end[1] == '<')
+		n <<= strtol(end + 2, &end, 0);
+	if (end == s || *end || errno)
+		error("bad number", s);
+	return complement ? ~n : n;
+}
+
+static uint32_t
+modmask(char *s)
+{
+	uint32_t mask = 0;
+	size_t i;
+	char *m;
+
+	if (!strcmp(s, "0"))
+		return 0;
+	for (m = strtok(s, "|"); m; m = strtok(NULL, "|")) {
+		for (i = 0; i < LENGTH(modifiers) && strcasecmp(modifiers[i].name, m); i++);
+		if (i == LENGTH(modifiers))
+			error("unknown modifier", m);
+		mask |= modifiers[i].mask;
+	}
+	return mask;
+}
+
+static uint32_t
+pattern(const char *s)
+{
+	return strcmp(s, "-") ? addstring(s) : RC_NONE;
+}
+
+static void
+argument(RcArgument *a, char **words, int n)
+{
+	int i;
+
+	memset(a, 0, sizeof(*a));
+	if (!n) {
+		a->type = RcArgNone;
+	} else if (!strcmp(words[0], "dmenu") && n == 1) {
+		a->type = RcArgDmenu;
+	} else if (!strcmp(words[0], "cmd") && n > 1) {
+		a->type = RcArgCommand;
+		a->v.command = addstring(words[1]);
+		for (i = 2; i < n; i++)
+			addstring(words[i]);
+		addstring("");
+	} else if (n != 2) {
+		error("bad argument", words[0]);
+	} else if (!strcmp(words[0], "i")) {
+		a->type = RcArgInt;
+		a->v.i = number(words[1]);
+	} else if (!strcmp(words[0], "ui")) {
+		a->type = RcArgUint;
+		a->v.ui = number(words[1]);
+	} else if (!strcmp(words[0], "f")) {
+		a->type = RcArgFloat;
+		a->v.f = strtof(words[1], NULL);
+	} else if (!strcmp(words[0], "layout")) {
+		a->type = RcArgLayout;
+		a->v.layout = number(words[1]);
+	} else {
+		error("bad argument", words[0]);
+	}
+}
+
+/* Catch what dwm would reject at load time: unknown functions and
+ * arguments the function cannot take */
+static void
+checkfunction(const char *name, const RcArgument *a)
+{
+	size_t i;
+
+	for (i = 0; i < LENGTH(functions) && strcmp(functions[i].name, name); i++);
+	if (i == LENGTH(functions))
+		error("unknown function", name);
+	if (!(functions[i].args & RC_ARG(a->type)))
+		error("wrong argument for", name);
+}
+
+static void
+parse(char *line)
+{
+	char *w[MAXWORDS];
+	int n = split(line, w);
+	size_t i;
+	KeySym sym;
+	RcRule *r;
+	RcKey *k;
+	RcButton *b;
+
+	if (!n)
+		return;
+	if (!strcmp(w[0], "rule")) {
+		if (n != 7)
+			error("rule takes 6 fields", NULL);
+		rules = grow(rules, nrules, sizeof(RcRule));
+		r = &rules[nrules++];
+		r->class = pattern(w[1]);
+		r->instance = pattern(w[2]);
+		r->title = pattern(w[3]);
+		r->tags = number(w[4]);
+		r->isfloating = number(w[5]);
+		r->monitor = number(w[6]);
+	} else if (!strcmp(w[0], "key")) {
+		if (n < 4)
+			error("key takes modifiers, keysym and function", NULL);
+		if ((sym = XStringToKeysym(w[2])) == NoSymbol)
+			error("unknown keysym", w[2]);
+		keys = grow(keys, nkeys, sizeof(RcKey));
+		k = &keys[nkeys++];
+		k->modifier = modmask(w[1]);
+		k->keysym = sym;
+		k->function = addstring(w[3]);
+		argument(&k->argument, w + 4, n - 4);
+		checkfunction(w[3], &k->argument);
+	} else if (!strcmp(w[0], "button")) {
+		if (n < 5)
+			error("button takes click, modifiers, button and function", NULL);
+		for (i = 0; i < LENGTH(clicks) && strcmp(clicks[i], w[1])
+		     && (strncmp(w[1], "Click", 5) || strcmp(clicks[i], w[1] + 5)); i++);
+		if (i == LENGTH(clicks))
+			error("unknown click", w[1]);
+		buttons = grow(buttons, nbuttons, sizeof(RcButton));
+		b = &buttons[nbuttons++];
+		b->click = i;
+		b->mask = modmask(w[2]);
+		b->button = number(!strncmp(w[3], "Button", 6) ? w[3] + 6 : w[3]);
+		b->function = addstring(w[4]);
+		argument(&b->argument, w + 5, n - 5);
+		checkfunction(w[4], &b->argument);
+	} else {
+		error("unknown entry", w[0]);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	char line[1024], *tmp;
+	RcHeader h;
+	FILE *in, *out;
+
+	if (argc != 3)
+		die("usage: dwmrc input output");
+	file = argv[1];
+	if (!strcmp(file, "-"))
+		in = stdin;
+	else if (!(in = fopen(file, "r")))
+		die("dwmrc: %s:", file);
+	while (fgets(line, sizeof(line), in)) {
+		lineno++;
+		if (!strchr(line, '\n') && !feof(in))
+			error("line too long", NULL);
+		parse(line);
+	}
+	if (ferror(in))
+		die("dwmrc: %s:", file);
+	addstring(""); /* the table always ends in a NUL byte */
+
+	memset(&h, 0, sizeof(h));
+	h.magic = RC_MAGIC;
+	h.version = RC_VERSION;
+	h.nrules = nrules;
+	h.nkeys = nkeys;
+	h.nbuttons = nbuttons;
+	h.nstrings = nstrings;
+	/* write beside the output and rename, so dwm never maps half a file */
+	tmp = ecalloc(strlen(argv[2]) + 5, 1);
+	sprintf(tmp, "%s.tmp", argv[2]);
+	if (!(out = fopen(tmp, "w")))
+		die("dwmrc: %s:", tmp);
+	fwrite(&h, sizeof(h), 1, out);
+	fwrite(rules, sizeof(RcRule), nrules, out);
+	fwrite(keys, sizeof(RcKey), nkeys, out);
+	fwrite(buttons, sizeof(RcButton), nbuttons, out);
+	fwrite(strings, 1, nstrings, out);
+	if (fclose(out) == EOF || rename(tmp, argv[2]) < 0) {
+		unlink(tmp);
+		die("dwmrc: %s:", argv[2]);
+	}
+	return 0;
+}
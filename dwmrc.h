@@ -0,0 +1,72 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdint.h>
+
+/* Precompiled rules and bindings, written by dwmrc from a text file and
+ * mmapped by dwm. A header is followed by the rule, key and button records
+ * and a string table that ends in a NUL byte. Words are in host byte order;
+ * strings are offsets into the table, RC_NONE for none. */
+#define RC_MAGIC                0x43525744  /* "DWRC" */
+#define RC_VERSION              1
+#define RC_NONE                 0xffffffffu
+
+enum { RcArgNone, RcArgInt, RcArgUint, RcArgFloat, RcArgLayout, RcArgCommand, RcArgDmenu };
+#define RC_ARG(T)               (1u << (T))
+
+/* The functions a binding may name and the argument types each accepts,
+ * checked by dwmrc when compiling and again by dwm when loading. Expand with
+ * F(name, types) */
+#define RC_FUNCTIONS(F) \
+	F(focusmon,       RC_ARG(RcArgInt)) \
+	F(focusStack,     RC_ARG(RcArgInt)) \
+	F(incnmaster,     RC_ARG(RcArgInt)) \
+	F(killclient,     RC_ARG(RcArgNone)) \
+	F(movemouse,      RC_ARG(RcArgNone)) \
+	F(quit,           RC_ARG(RcArgNone)) \
+	F(resizemouse,    RC_ARG(RcArgNone)) \
+	F(restart,        RC_ARG(RcArgNone)) \
+	F(setlayout,      RC_ARG(RcArgLayout) | RC_ARG(RcArgNone)) \
+	F(setmfact,       RC_ARG(RcArgFloat)) \
+	F(spawn,          RC_ARG(RcArgCommand) | RC_ARG(RcArgDmenu)) \
+	F(tag,            RC_ARG(RcArgUint) | RC_ARG(RcArgInt) | RC_ARG(RcArgNone)) \
+	F(tagmon,         RC_ARG(RcArgInt)) \
+	F(toggleBar,      RC_ARG(RcArgNone)) \
+	F(togglefloating, RC_ARG(RcArgNone)) \
+	F(toggletag,      RC_ARG(RcArgUint) | RC_ARG(RcArgInt) | RC_ARG(RcArgNone)) \
+	F(toggleview,     RC_ARG(RcArgUint) | RC_ARG(RcArgInt) | RC_ARG(RcArgNone)) \
+	F(view,           RC_ARG(RcArgUint) | RC_ARG(RcArgInt) | RC_ARG(RcArgNone)) \
+	F(zoom,           RC_ARG(RcArgNone))
+
+typedef struct {
+	uint32_t magic, version;
+	uint32_t nrules, nkeys, nbuttons;
+	uint32_t nstrings;       /* size of the string table */
+} RcHeader;
+
+typedef struct {
+	uint32_t type;
+	union {
+		int32_t i;
+		uint32_t ui;
+		float f;
+		uint32_t layout;     /* index into layouts[] */
+		uint32_t command;    /* string list ended by an empty string */
+	} v;
+} RcArgument;
+
+typedef struct {
+	uint32_t class, instance, title;
+	uint32_t tags;
+	int32_t isfloating, monitor;
+} RcRule;
+
+typedef struct {
+	uint32_t modifier, keysym;
+	uint32_t function;       /* name, resolved by dwm */
+	RcArgument argument;
+} RcKey;
+
+typedef struct {
+	uint32_t click, mask, button;
+	uint32_t function;
+	RcArgument argument;
+} RcButton;
@@ -0,0 +1,177 @@
+/* See LICENSE file for copyright and license details. */
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+#include "util.h"
+
+#define JOURNAL_MAGIC           0x4e4a5744  /* "DWJN" */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t recordSize;
+	uint32_t capacity;       /* records in the ring */
+	uint32_t unused;
+	uint64_t base;           /* records before this one were compacted away */
+	uint64_t seq;            /* next record */
+	uint64_t token;          /* names the X server the records belong to, see journal_reset() */
+} Header;
+
+static Header *header;
+static JournalRecord *ring;
+static int fd = -1;
+
+static size_t
+filesize(size_t capacity)
+{
+	return sizeof(Header) + capacity * sizeof(JournalRecord);
+}
+
+static int
+map(size_t capacity)
+{
+	void *p;
+
+	if (header)
+		munmap(header, filesize(header->capacity));
+	header = NULL;
+	if (ftruncate(fd, filesize(capacity)) < 0
+	|| (p = mmap(NULL, filesize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		return -1;
+	header = p;
+	ring = (JournalRecord *)(header + 1);
+	return 0;
+}
+
+/* Open or create the journal, keeping what an earlier session left in it */
+int
+journal_open(const char *path, size_t capacity)
+{
+	struct stat st;
+	Header h;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0 || fstat(fd, &st) < 0)
+		goto fail;
+	if ((size_t)st.st_size >= sizeof(Header) && pread(fd, &h, sizeof(h), 0) == sizeof(h)
+	&& h.magic == JOURNAL_MAGIC && h.recordSize == sizeof(JournalRecord)
+	&& (size_t)st.st_size == filesize(h.capacity) && h.capacity && h.base <= h.seq)
+		return map(h.capacity);
+	/* new, or written by a dwm with another record layout */
+	if (ftruncate(fd, 0) < 0 || map(capacity) < 0)
+		goto fail;
+	header->magic = JOURNAL_MAGIC;
+	header->recordSize = sizeof(JournalRecord);
+	header->capacity = capacity;
+	header->base = header->seq = 1;
+	return 0;
+fail:
+	journal_close();
+	return -1;
+}
+
+void
+journal_close(void)
+{
+	if (header)
+		munmap(header, filesize(header->capacity));
+	header = NULL;
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+/* The token set by the last journal_reset(), 0 if none or not open */
+uint64_t
+journal_token(void)
+{
+	return header ? header->token : 0;
+}
+
+/* Drop every record, they describe windows of another X server, and tag
+ * the journal with the token of the current one */
+void
+journal_reset(uint64_t token)
+{
+	if (!header)
+		return;
+	header->base = header->seq;
+	header->token = token;
+}
+
+/* Append a record; returns 1 once half the ring has been written since the
+ * last compaction and journal_compact() should be run */
+int
+journal_write(JournalRecord *r)
+{
+	JournalRecord *slot;
+
+	if (!header)
+		return 0;
+	slot = &ring[header->seq % header->capacity];
+	slot->seq = 0; /* the sequence number goes in last */
+	r->seq = 0;
+	memcpy(slot, r, sizeof(*r));
+	slot->seq = header->seq++;
+	return header->seq - header->base >= header->capacity / 2;
+}
+
+/* Write the live state as the new start of the journal, growing the ring
+ * if it would otherwise fill up with it */
+void
+journal_compact(JournalRecord *live, size_t n)
+{
+	size_t i, capacity;
+	uint64_t base;
+
+	if (!header)
+		return;
+	for (capacity = header->capacity; capacity < n * 4; capacity *= 2);
+	if (capacity != header->capacity) {
+		if (map(capacity) < 0) {
+			journal_close();
+			return;
+		}
+		header->capacity = capacity;
+	}
+	base = header->seq;
+	for (i = 0; i < n; i++)
+		journal_write(&live[i]);
+	/* older records only become stale once the new ones are all in place */
+	header->base = base;
+}
+
+static int
+comparerecord(const void *a, const void *b)
+{
+	const JournalRecord *x = a, *y = b;
+
+	if (x->window != y->window)
+		return x->window > y->window ? 1 : -1;
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/* Return the latest record of every window still managed when the journal
+ * was last written, sorted by window */
+JournalRecord *
+journal_replay(size_t *n)
+{
+	JournalRecord *r;
+	size_t i, j;
+
+	*n = 0;
+	if (!header)
+		return NULL;
+	r = ecalloc(header->capacity, sizeof(JournalRecord));
+	for (i = j = 0; i < header->capacity; i++)
+		if (ring[i].seq >= header->base && ring[i].seq < header->seq)
+			r[j++] = ring[i];
+	qsort(r, j, sizeof(JournalRecord), comparerecord);
+	for (i = 0; i < j; i++)
+		if ((i + 1 == j || r[i + 1].window != r[i].window) && !(r[i].flags & JOURNAL_GONE))
+			r[(*n)++] = r[i];
+	return r;
+}
@@ -0,0 +1,26 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdint.h>
+
+#define JOURNAL_FLOATING        1
+#define JOURNAL_GONE            2    /* the window is no longer managed */
+
+typedef struct {
+	uint64_t seq;            /* set by journal_write(), 0 marks an unused slot */
+	uint32_t window;
+	uint32_t tags;
+	int32_t monitor;
+	int32_t x, y, w, h;
+	uint32_t flags;
+} JournalRecord;
+
+/* Session journal: client state changes appended to a ring in an mmapped
+ * file. Nothing is synced, the page cache survives a crash of dwm, and a
+ * compaction now and then rewrites the live state so the ring never wraps
+ * over a record that is still current. */
+int journal_open(const char *path, size_t capacity);
+void journal_close(void);
+int journal_write(JournalRecord *r);
+void journal_compact(JournalRecord *live, size_t n);
+JournalRecord *journal_replay(size_t *n);
+void journal_reset(uint64_t token);
+uint64_t journal_token(void);
@@ -0,0 +1,118 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdlib.h>
+#include <string.h>
+
+#include "match.h"
+#include "util.h"
+
+typedef struct {
+	size_t child, sibling;   /* first child and next sibling, 0 for none (0 is the root) */
+	size_t fail;             /* longest proper suffix that is also a trie state */
+	size_t output;           /* nearest state on the fail chain where patterns end, 0 for none */
+	long first;              /* first pattern ending here, -1 for none */
+	unsigned char c;
+} State;
+
+struct Matcher {
+	State *states;
+	size_t nstates;
+	long *next;              /* next pattern ending in the same state, -1 terminated */
+};
+
+static size_t
+child(const Matcher *m, size_t s, unsigned char c)
+{
+	for (s = m->states[s].child; s && m->states[s].c != c; s = m->states[s].sibling)
+		;
+	return s;
+}
+
+/* Build the trie of the non-NULL patterns and link it up breadth first;
+ * pattern i is reported to match_run() callers as id i */
+Matcher *
+match_compile(const char *const *patterns, size_t n)
+{
+	Matcher *m = ecalloc(1, sizeof(Matcher));
+	size_t i, s, t, f, len, head, tail, *queue;
+	const unsigned char *p;
+
+	for (i = 0, len = 1; i < n; i++)
+		if (patterns[i])
+			len += strlen(patterns[i]);
+	m->states = ecalloc(len, sizeof(State));
+	m->next = ecalloc(n ? n : 1, sizeof(long));
+	m->nstates = 1;
+	m->states[0].first = -1;
+
+	for (i = 0; i < n; i++) {
+		if (!patterns[i])
+			continue;
+		for (s = 0, p = (const unsigned char *)patterns[i]; *p; s = t, p++) {
+			if ((t = child(m, s, *p)))
+				continue;
+			t = m->nstates++;
+			m->states[t].c = *p;
+			m->states[t].first = -1;
+			m->states[t].sibling = m->states[s].child;
+			m->states[s].child = t;
+		}
+		m->next[i] = m->states[s].first;
+		m->states[s].first = i;
+	}
+
+	queue = ecalloc(m->nstates, sizeof(size_t));
+	head = tail = 0;
+	for (t = m->states[0].child; t; t = m->states[t].sibling)
+		queue[tail++] = t; /* depth one falls back to the root */
+	while (head < tail) {
+		s = queue[head++];
+		for (t = m->states[s].child; t; t = m->states[t].sibling) {
+			for (f = m->states[s].fail; f && !child(m, f, m->states[t].c); f = m->states[f].fail)
+				;
+			m->states[t].fail = child(m, f, m->states[t].c);
+			f = m->states[t].fail;
+			m->states[t].output = m->states[f].first >= 0 ? f : m->states[f].output;
+			queue[tail++] = t;
+		}
+	}
+	free(queue);
+	return m;
+}
+
+void
+match_free(Matcher *m)
+{
+	if (!m)
+		return;
+	free(m->states);
+	free(m->next);
+	free(m);
+}
+
+static void
+report(const Matcher *m, size_t s, void (*hit)(size_t id, void *arg), void *arg)
+{
+	long i;
+
+	for (i = m->states[s].first; i >= 0; i = m->next[i])
+		hit(i, arg);
+}
+
+/* Call hit once for every position where a pattern ends, so a pattern that
+ * occurs twice is reported twice */
+void
+match_run(const Matcher *m, const char *text, void (*hit)(size_t id, void *arg), void *arg)
+{
+	size_t s = 0, t, o;
+	const unsigned char *p;
+
+	report(m, 0, hit, arg); /* empty patterns match anything */
+	for (p = (const unsigned char *)text; *p; p++) {
+		while (!(t = child(m, s, *p)) && s)
+			s = m->states[s].fail;
+		s = t;
+		report(m, s, hit, arg);
+		for (o = m->states[s].output; o; o = m->states[o].output)
+			report(m, o, hit, arg);
+	}
+}
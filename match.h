@@ -0,0 +1,9 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Multi-pattern substring matcher (Aho-Corasick): one pass over a string
+ * reports every pattern that occurs in it. */
+typedef struct Matcher Matcher;
+
+Matcher *match_compile(const char *const *patterns, size_t n);
+void match_free(Matcher *m);
+void match_run(const Matcher *m, const char *text, void (*hit)(size_t id, void *arg), void *arg);
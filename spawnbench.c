@@ -0,0 +1,126 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * spawnbench measures the keypress-to-exec latency of dwm's spawn(): the
+ * time from calling spawncmd() until the command has been exec'd, while the
+ * process holds a resident set as large as a long running dwm with its font
+ * caches. For comparison it times fork() and execvp() too, the way dwm used
+ * to start commands.
+ *
+ *	spawnbench [-n runs] [-m MiB] [command [argument...]]
+ *
+ * The command defaults to true. Exec is taken as the moment a close-on-exec
+ * pipe held by the child reaches end of file.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "util.h"
+
+static char *defaultcmd[] = { "true", NULL };
+char *resident; /* not static, so the pages it holds cannot be optimized away */
+
+static int
+compare(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double
+elapsed(const struct timespec *t0)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) * 1e6 + (t.tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+/* Start argv once and return the microseconds until it exec'd */
+static double
+run(char **argv, int usefork)
+{
+	struct timespec t0;
+	double us;
+	pid_t pid;
+	char c;
+	int fds[2], err;
+
+	if (pipe(fds) < 0)
+		die("spawnbench: pipe:");
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (usefork) {
+		if ((pid = fork()) < 0)
+			die("spawnbench: fork:");
+		if (pid == 0) {
+			setsid();
+			execvp(argv[0], argv);
+			_exit(127);
+		}
+	} else if ((err = spawncmd(argv, &pid))) {
+		errno = err;
+		die("spawnbench: cannot spawn %s:", argv[0]);
+	}
+	close(fds[1]);
+	while (read(fds[0], &c, 1) < 0 && errno == EINTR);
+	us = elapsed(&t0);
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+	return us;
+}
+
+static void
+report(const char *name, double *t, int n)
+{
+	qsort(t, n, sizeof(double), compare);
+	printf("%-12s min %8.1f  median %8.1f  p99 %8.1f  max %8.1f us\n",
+	       name, t[0], t[n / 2], t[(n * 99) / 100], t[n - 1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char **cmd = defaultcmd;
+	double *t;
+	size_t mib = 256;
+	int i, n = 200;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			n = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			mib = strtoul(argv[++i], NULL, 10);
+		else
+			die("usage: spawnbench [-n runs] [-m MiB] [command [argument...]]");
+	}
+	if (i < argc)
+		cmd = &argv[i];
+	if (n < 1)
+		die("spawnbench: runs must be positive");
+	/* touch every page, so fork() has page tables to copy */
+	if (mib) {
+		if (!(resident = malloc(mib << 20)))
+			die("spawnbench: malloc:");
+		memset(resident, 1, mib << 20);
+	}
+	t = ecalloc(n, sizeof(double));
+
+	printf("%d runs of %s with %zu MiB resident\n", n, cmd[0], mib);
+	for (i = 0; i < n; i++)
+		t[i] = run(cmd, 0);
+	report("posix_spawn", t, n);
+	for (i = 0; i < n; i++)
+		t[i] = run(cmd, 1);
+	report("fork", t, n);
+	free(t);
+	return 0;
+}
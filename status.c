@@ -0,0 +1,357 @@
+/* See LICENSE file for copyright and license details. */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "status.h"
+#include "util.h"
+
+#define BLOCK_MAX               64
+
+typedef struct {
+	const StatusBlock *block;
+	char text[BLOCK_MAX];    /* last output, the status is only rebuilt when it changes */
+	long long due;           /* next run, ms on CLOCK_MONOTONIC */
+} Block;
+
+static Block *blocks;
+static size_t nblocks;
+static const char *separator;
+static char text[STATUS_MAX];
+static int timerfd = -1;
+static int fifofd = -1;
+static const char *fifopath;  /* set when we created the FIFO and should remove it */
+static char line[STATUS_MAX]; /* partial line read from the FIFO */
+static size_t linelen;
+static int discarding;        /* the current line is too long and is dropped */
+
+static long long
+msnow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Read a small /proc or /sys file, without going through stdio */
+static int
+readfile(const char *path, char *buf, size_t size)
+{
+	int fd;
+	ssize_t n;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = '\0';
+	return 1;
+}
+
+static void
+join(void)
+{
+	size_t i, len = 0;
+	int n;
+
+	text[0] = '\0';
+	for (i = 0; i < nblocks; i++) {
+		if (!blocks[i].text[0])
+			continue;
+		n = snprintf(text + len, sizeof(text) - len, "%s%s", len ? separator : "", blocks[i].text);
+		if (n < 0 || (len += n) >= sizeof(text) - 1)
+			break;
+	}
+}
+
+static int
+runblock(Block *b)
+{
+	char buf[BLOCK_MAX];
+
+	if (!b->block->fn) /* only set through the FIFO */
+		return 0;
+	if (!b->block->fn(buf, sizeof(buf), b->block->arg))
+		buf[0] = '\0';
+	if (!strcmp(buf, b->text))
+		return 0;
+	strcpy(b->text, buf);
+	return 1;
+}
+
+/* Set a block from a "<block> <text>" line, without rejoining the status */
+static int
+setline(char *s)
+{
+	size_t i;
+	char *value, buf[BLOCK_MAX];
+
+	if ((value = strchr(s, ' ')))
+		*value++ = '\0';
+	else
+		value = ""; /* a bare name clears the block */
+	for (i = 0; i < nblocks && strcmp(blocks[i].block->name, s); i++);
+	/* a value that does not fit is dropped rather than cut */
+	if (i == nblocks || strlen(value) >= sizeof(buf))
+		return 0;
+	snprintf(buf, sizeof(buf), "%s", value);
+	if (!strcmp(buf, blocks[i].text))
+		return 0;
+	strcpy(blocks[i].text, buf);
+	return 1;
+}
+
+/* Arm the timer for the block that is due first */
+static void
+arm(void)
+{
+	size_t i;
+	long long due = 0;
+	struct itimerspec its;
+
+	for (i = 0; i < nblocks; i++)
+		if (blocks[i].block->interval && (!due || blocks[i].due < due))
+			due = blocks[i].due;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = due / 1000;
+	its.it_value.tv_nsec = due % 1000 * 1000000;
+	timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* Run every block once and return the timerfd to wait on, or -1 */
+int
+status_init(const StatusBlock *b, size_t n, const char *sep)
+{
+	size_t i;
+	long long t = msnow();
+
+	if ((timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+		return -1;
+	blocks = ecalloc(n, sizeof(Block));
+	nblocks = n;
+	separator = sep;
+	for (i = 0; i < n; i++) {
+		blocks[i].block = &b[i];
+		blocks[i].due = t + b[i].interval * 1000LL;
+		runblock(&blocks[i]);
+	}
+	join();
+	arm();
+	return timerfd;
+}
+
+void
+status_free(void)
+{
+	if (fifofd >= 0)
+		close(fifofd);
+	if (fifopath)
+		unlink(fifopath);
+	fifofd = -1;
+	fifopath = NULL;
+	if (timerfd >= 0)
+		close(timerfd);
+	timerfd = -1;
+	free(blocks);
+	blocks = NULL;
+	nblocks = 0;
+}
+
+/* Run the blocks that are due; returns 1 if the status text changed */
+int
+status_tick(void)
+{
+	size_t i;
+	int changed = 0;
+	long long interval, t = msnow();
+	uint64_t expirations;
+
+	if (read(timerfd, &expirations, sizeof(expirations)) < 0)
+		; /* spurious wakeup, the blocks below decide what is due */
+	for (i = 0; i < nblocks; i++) {
+		if (!(interval = blocks[i].block->interval * 1000LL) || blocks[i].due > t)
+			continue;
+		changed |= runblock(&blocks[i]);
+		/* keep the cadence, skipping periods missed while busy */
+		do
+			blocks[i].due += interval;
+		while (blocks[i].due <= t);
+	}
+	arm();
+	if (changed)
+		join();
+	return changed;
+}
+
+/* Create the status FIFO if needed and return its descriptor, or -1. It is
+ * opened for writing too, so it never reports end of file between writers. */
+int
+status_openfifo(const char *path)
+{
+	struct stat st;
+
+	if (mkfifo(path, 0600) == 0)
+		fifopath = path;
+	else if (stat(path, &st) < 0 || !S_ISFIFO(st.st_mode))
+		return -1;
+	if ((fifofd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0 && fifopath) {
+		unlink(fifopath);
+		fifopath = NULL;
+	}
+	return fifofd;
+}
+
+/* Read "<block> <text>" lines from the FIFO; returns 1 if the status text changed */
+int
+status_readfifo(void)
+{
+	char buf[1024], *p, *end;
+	ssize_t n;
+	int changed = 0;
+
+	while ((n = read(fifofd, buf, sizeof(buf))) > 0) {
+		for (p = buf, end = buf + n; p < end; p++) {
+			if (*p != '\n') {
+				if (linelen < sizeof(line) - 1)
+					line[linelen++] = *p;
+				else
+					discarding = 1;
+				continue;
+			}
+			line[linelen] = '\0';
+			if (!discarding)
+				changed |= setline(line);
+			linelen = 0;
+			discarding = 0;
+		}
+	}
+	if (changed)
+		join();
+	return changed;
+}
+
+const char *
+status_text(void)
+{
+	return text;
+}
+
+int
+status_battery(char *buf, size_t size, const char *arg)
+{
+	char path[128], capacity[16], state[32];
+
+	snprintf(path, sizeof(path), "/sys/class/power_supply/%s/capacity", arg ? arg : "BAT0");
+	if (!readfile(path, capacity, sizeof(capacity)))
+		return 0;
+	snprintf(path, sizeof(path), "/sys/class/power_supply/%s/status", arg ? arg : "BAT0");
+	if (!readfile(path, state, sizeof(state)))
+		state[0] = '\0';
+	return snprintf(buf, size, "bat %d%%%s", atoi(capacity),
+	                !strncmp(state, "Charging", 8) ? "+" :
+	                !strncmp(state, "Discharging", 11) ? "-" : "") > 0;
+}
+
+int
+status_clock(char *buf, size_t size, const char *arg)
+{
+	time_t t = time(NULL);
+	struct tm tm;
+
+	if (!localtime_r(&t, &tm))
+		return 0;
+	return strftime(buf, size, arg ? arg : "%H:%M", &tm) > 0;
+}
+
+int
+status_load(char *buf, size_t size, const char *arg)
+{
+	char s[64];
+	double avg[3];
+
+	if (!readfile("/proc/loadavg", s, sizeof(s))
+	|| sscanf(s, "%lf %lf %lf", &avg[0], &avg[1], &avg[2]) != 3)
+		return 0;
+	return snprintf(buf, size, "%.2f %.2f %.2f", avg[0], avg[1], avg[2]) > 0;
+}
+
+int
+status_memory(char *buf, size_t size, const char *arg)
+{
+	char s[256], *p;
+	unsigned long total, available;
+
+	/* MemTotal, MemFree and MemAvailable are the first lines */
+	if (!readfile("/proc/meminfo", s, sizeof(s))
+	|| !(p = strstr(s, "MemTotal:")) || !(total = strtoul(p + 9, NULL, 10))
+	|| !(p = strstr(s, "MemAvailable:")))
+		return 0;
+	available = strtoul(p + 13, NULL, 10);
+	return snprintf(buf, size, "mem %lu%%", (total - MIN(available, total)) * 100 / total) > 0;
+}
+
+static void
+humanrate(char *buf, size_t size, unsigned long long rate)
+{
+	const char *unit = "BKMGT";
+
+	while (rate >= 1024 * 10 && unit[1]) {
+		rate /= 1024;
+		unit++;
+	}
+	if (rate >= 1024 && unit[1])
+		snprintf(buf, size, "%.1f%c", rate / 1024.0, unit[1]);
+	else
+		snprintf(buf, size, "%llu%c", rate, unit[0]);
+}
+
+int
+status_netrate(char *buf, size_t size, const char *arg)
+{
+	static struct {
+		const char *iface;
+		unsigned long long rx, tx;
+		long long time;
+	} last[4];
+	char path[128], s[32], rxs[16], txs[16];
+	unsigned long long rx, tx;
+	long long dt, t = msnow();
+	size_t i;
+
+	if (!arg)
+		return 0;
+	snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/rx_bytes", arg);
+	if (!readfile(path, s, sizeof(s)))
+		return 0;
+	rx = strtoull(s, NULL, 10);
+	snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/tx_bytes", arg);
+	if (!readfile(path, s, sizeof(s)))
+		return 0;
+	tx = strtoull(s, NULL, 10);
+
+	for (i = 0; i < sizeof(last) / sizeof(last[0]) && last[i].iface && strcmp(last[i].iface, arg); i++);
+	if (i == sizeof(last) / sizeof(last[0]))
+		return 0;
+	if (!last[i].iface || rx < last[i].rx || tx < last[i].tx) { /* first reading or counter reset */
+		humanrate(rxs, sizeof(rxs), 0);
+		humanrate(txs, sizeof(txs), 0);
+	} else {
+		dt = MAX(t - last[i].time, 1);
+		humanrate(rxs, sizeof(rxs), (rx - last[i].rx) * 1000 / dt);
+		humanrate(txs, sizeof(txs), (tx - last[i].tx) * 1000 / dt);
+	}
+	last[i].iface = arg;
+	last[i].rx = rx;
+	last[i].tx = tx;
+	last[i].time = t;
+	return snprintf(buf, size, "rx %s tx %s", rxs, txs) > 0;
+}
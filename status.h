@@ -0,0 +1,27 @@
+/* See LICENSE file for copyright and license details. */
+
+#define STATUS_MAX              256   /* longest status text, including the terminator */
+
+typedef struct {
+	const char *name;
+	int (*fn)(char *buf, size_t size, const char *arg); /* 0 hides the block, NULL means FIFO only */
+	const char *arg;
+	unsigned int interval;   /* seconds between updates, 0 runs it once */
+} StatusBlock;
+
+/* Status engine: blocks run on a timerfd or are set by name through a FIFO,
+ * and their text is cached so the joined status only changes when a block's
+ * value does. */
+int status_init(const StatusBlock *blocks, size_t n, const char *separator);
+int status_openfifo(const char *path);
+int status_readfifo(void);
+void status_free(void);
+int status_tick(void);
+const char *status_text(void);
+
+/* Blocks */
+int status_battery(char *buf, size_t size, const char *arg);
+int status_clock(char *buf, size_t size, const char *arg);
+int status_load(char *buf, size_t size, const char *arg);
+int status_memory(char *buf, size_t size, const char *arg);
+int status_netrate(char *buf, size_t size, const char *arg);
@@ -1,11 +1,27 @@
 /* See LICENSE file for copyright and license details. */
+#define _GNU_SOURCE /* posix_spawn session and closefrom extensions */
+#include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 34)
+#define HAVE_ADDCLOSEFROM
+#endif
+#endif
+#ifndef HAVE_ADDCLOSEFROM
+#include <linux/close_range.h>
+#include <sys/syscall.h>
+#endif
 
 #include "util.h"
 
+extern char **environ;
+
 void *
 ecalloc(size_t nmemb, size_t size)
 {
@@ -33,3 +49,95 @@ die(const char *fmt, ...) {
 
 	exit(1);
 }
+
+void
+pool_init(Pool *p, size_t size, size_t perslab)
+{
+	size = MAX(size, sizeof(void *));
+	p->size = (size + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+	p->perslab = MAX(perslab, 1);
+	p->slabs = p->freelist = NULL;
+	p->live = p->peak = p->nslabs = 0;
+}
+
+void *
+pool_alloc(Pool *p)
+{
+	char *slab, *obj;
+	size_t i;
+
+	if (!p->freelist) {
+		/* the first slot of a slab links it into the slab list */
+		if (posix_memalign((void **)&slab, POOL_ALIGN, (p->perslab + 1) * p->size))
+			die("posix_memalign:");
+		*(void **)slab = p->slabs;
+		p->slabs = slab;
+		p->nslabs++;
+		for (i = p->perslab; i > 0; i--) {
+			obj = slab + i * p->size;
+			*(void **)obj = p->freelist;
+			p->freelist = obj;
+		}
+	}
+	obj = p->freelist;
+	p->freelist = *(void **)obj;
+	memset(obj, 0, p->size);
+	if (++p->live > p->peak)
+		p->peak = p->live;
+	return obj;
+}
+
+void
+pool_free(Pool *p, void *obj)
+{
+	if (!obj)
+		return;
+	*(void **)obj = p->freelist;
+	p->freelist = obj;
+	p->live--;
+}
+
+void
+pool_destroy(Pool *p)
+{
+	void *slab;
+
+	while ((slab = p->slabs)) {
+		p->slabs = *(void **)slab;
+		free(slab);
+	}
+	p->freelist = NULL;
+	p->live = p->nslabs = 0;
+}
+
+/* Start argv without copying the caller's address space: posix_spawn runs
+ * the child on our memory until it execs, so exec failures come back as the
+ * return value. The child gets a session of its own, default signal
+ * handling, an empty signal mask and no descriptors beyond stdio. */
+int
+spawncmd(char *const argv[], pid_t *pid)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t none, all;
+	int err;
+
+	posix_spawn_file_actions_init(&actions);
+#ifdef HAVE_ADDCLOSEFROM
+	posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#elif defined(SYS_close_range)
+	/* glibc before 2.34 cannot close a range in the child, so mark ours
+	 * close-on-exec instead (Linux 5.11) */
+	syscall(SYS_close_range, STDERR_FILENO + 1, ~0U, CLOSE_RANGE_CLOEXEC);
+#endif
+	posix_spawnattr_init(&attr);
+	sigemptyset(&none);
+	sigfillset(&all);
+	posix_spawnattr_setsigmask(&attr, &none);
+	posix_spawnattr_setsigdefault(&attr, &all);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+	err = posix_spawnp(pid, argv[0], &actions, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	return err;
+}
@@ -4,5 +4,24 @@
 #define MIN(A, B)               ((A) < (B) ? (A) : (B))
 #define BETWEEN(X, A, B)        ((A) <= (X) && (X) <= (B))
 
+/* Fixed-size object pool: objects are carved out of cache line aligned
+ * slabs and recycled through a free list, never returned to the heap
+ * before pool_destroy. */
+typedef struct {
+	size_t size;           /* slot size, rounded up to POOL_ALIGN */
+	size_t perslab;        /* slots per slab */
+	void *slabs;           /* allocated slabs, linked through their first slot */
+	void *freelist;        /* free slots, linked through their first word */
+	size_t live, peak;     /* objects in use, highest number ever in use */
+	size_t nslabs;
+} Pool;
+
+#define POOL_ALIGN              64
+
 void die(const char *fmt, ...);
 void *ecalloc(size_t nmemb, size_t size);
+void pool_init(Pool *p, size_t size, size_t perslab);
+void *pool_alloc(Pool *p);
+void pool_free(Pool *p, void *obj);
+void pool_destroy(Pool *p);
+int spawncmd(char *const argv[], pid_t *pid);